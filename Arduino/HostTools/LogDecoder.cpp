@@ -0,0 +1,66 @@
+// Decoder for the binary log records of a LOG_BINARY 1 build (QuantumDice/LogRecords.h). Text output is
+// passed through, each record frame is expanded with the same format table the firmware was built with:
+//
+//   g++ -std=c++17 -O2 -I../QuantumDice LogDecoder.cpp ../QuantumDice/LogRecords.cpp ../QuantumDice/DiceOutcome.cpp -o logdecoder
+//   ./logdecoder < capture.bin        or        ./logdecoder /dev/ttyACM0
+//
+// Build it from the same commit as the firmware: the format IDs are positions in LOG_FORMATS.
+#include <cstdio>
+#include <cstdint>
+#include "LogRecords.h"
+
+static bool readByte(FILE *in, uint8_t &value) {
+  int c = fgetc(in);
+  if (c == EOF) {
+    return false;
+  }
+  value = (uint8_t)c;
+  return true;
+}
+
+// Marker already read. False at the end of the input or on a frame that cannot be a record
+static bool readRecord(FILE *in, LogRecord &record) {
+  if (!readByte(in, record.format) || !readByte(in, record.argCount) || record.argCount > LOG_RECORD_ARGS) {
+    return false;
+  }
+  for (uint8_t i = 0; i < record.argCount; i++) {
+    uint32_t word = 0;
+    for (uint8_t shift = 0; shift < 32; shift += 8) {
+      uint8_t value;
+      if (!readByte(in, value)) {
+        return false;
+      }
+      word |= (uint32_t)value << shift;
+    }
+    record.args[i] = word;
+  }
+  return true;
+}
+
+int main(int argc, char **argv) {
+  FILE *in = stdin;
+  if (argc > 1 && !(in = fopen(argv[1], "rb"))) {
+    perror(argv[1]);
+    return 1;
+  }
+  unsigned long records = 0, broken = 0;
+  uint8_t value;
+  while (readByte(in, value)) {
+    if (value != LOG_RECORD_MARKER) {
+      putchar(value);
+      continue;
+    }
+    LogRecord record = {};
+    if (!readRecord(in, record)) {
+      broken++;
+      continue;
+    }
+    char text[256];
+    expandLogRecord(record, text, sizeof(text));
+    puts(text);
+    records++;
+    fflush(stdout);
+  }
+  fprintf(stderr, "%lu records, %lu broken\n", records, broken);
+  return 0;
+}
@@ -0,0 +1,208 @@
+// Monte Carlo of the outcome engine (QuantumDice/DiceOutcome.h) on a PC, on all cores.
+// The engine only needs DiceTypes.h, so no Arduino core or stubs are involved:
+//
+//   g++ -std=c++17 -O2 -pthread -I../QuantumDice OutcomeSimulator.cpp ../QuantumDice/DiceOutcome.cpp -o outcomesim
+//   ./outcomesim [<throws per scenario>]
+//
+// Scenarios with random axes and sister results: a single die, a die measured again, an entangled pair
+// (with and without alwaysSeven), a die measured after the entanglement ended, and die A switching
+// between B1 and B2. One CSV line per scenario:
+// outcome,<scenario>,<throws>,<count 1..6>,<count per rule>,<pairs>,<pairs on opposite faces>,<stale>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <random>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include "DiceOutcome.h"
+
+#define OUTCOME_DEFAULT_THROWS 1000000  //per scenario
+#define OUTCOME_RULES ((uint8_t)OutcomeRule::UNCHANGED + 1)
+
+enum class OutcomeScenario : uint8_t {
+  SINGLE,
+  REMEASURE,
+  ENTANGLED,
+  ENTANGLED_SEVEN,  //alwaysSeven
+  AFTER_ENT,
+  SWITCHING,        //A entangles with B1 and B2 in turn
+  COUNT
+};
+
+struct OutcomeTally {
+  uint64_t numbers[6];
+  uint64_t rules[OUTCOME_RULES];
+  uint64_t pairs;     //entangled: both dice measured along the rule's axis condition
+  uint64_t opposite;  //of those, pairs showing opposite faces
+  uint64_t stale;     //switching: A opposite to the previous partner instead of the current one
+};
+
+// Opposite faces of a die, written out instead of relying on the enum values summing to 7
+static const struct {
+  DiceNumbers number, opposite;
+} oppositeFaces[] = {
+  { DiceNumbers::ONE, DiceNumbers::SIX }, { DiceNumbers::TWO, DiceNumbers::FIVE }, { DiceNumbers::THREE, DiceNumbers::FOUR },
+  { DiceNumbers::FOUR, DiceNumbers::THREE }, { DiceNumbers::FIVE, DiceNumbers::TWO }, { DiceNumbers::SIX, DiceNumbers::ONE },
+};
+
+static bool onOppositeFaces(DiceNumbers a, DiceNumbers b) {
+  for (const auto &face : oppositeFaces) {
+    if (face.number == a) {
+      return face.opposite == b;
+    }
+  }
+  return false;
+}
+
+static const char *scenarioName(uint8_t scenario) {
+  switch ((OutcomeScenario)scenario) {
+    case OutcomeScenario::SINGLE: return "single";
+    case OutcomeScenario::REMEASURE: return "remeasure";
+    case OutcomeScenario::ENTANGLED: return "entangled";
+    case OutcomeScenario::ENTANGLED_SEVEN: return "entangledSeven";
+    case OutcomeScenario::AFTER_ENT: return "afterEnt";
+    case OutcomeScenario::SWITCHING: return "switching";
+    default: return "?";
+  }
+}
+
+// The engine takes a plain function as random source, so every thread keeps its own generator
+static thread_local std::mt19937 generator;
+
+static DiceNumbers simulatedRoll() {
+  return (DiceNumbers)((uint8_t)DiceNumbers::ONE + generator() % 6);
+}
+
+static MeasuredAxises randomAxis() {
+  return (MeasuredAxises)((uint8_t)MeasuredAxises::XAXIS + generator() % 3);
+}
+
+static void count(OutcomeTally &tally, const Outcome &outcome) {
+  uint8_t number = (uint8_t)outcome.diceNumber - (uint8_t)DiceNumbers::ONE;
+  if (number < 6) {
+    tally.numbers[number]++;
+  }
+  tally.rules[(uint8_t)outcome.rule]++;
+}
+
+// One die measures first, the other one with the first result as its sister, like the firmware
+// where the sister's number arrives over ESP-NOW. Returns the second die
+static Outcome measurePair(OutcomeTally &tally, DiceStates entangled, DiceStates unentangled, bool alwaysSeven,
+                           MeasuredAxises &firstAxis, Outcome &first, MeasuredAxises &secondAxis) {
+  firstAxis = randomAxis();
+  OutcomeInputs firstInputs = { entangled, firstAxis, MeasuredAxises::UNDEFINED, DiceNumbers::NONE,
+                                MeasuredAxises::UNDEFINED, DiceNumbers::NONE, alwaysSeven };
+  first = determineOutcome(firstInputs, simulatedRoll);
+  secondAxis = randomAxis();
+  OutcomeInputs secondInputs = { unentangled, secondAxis, MeasuredAxises::UNDEFINED, DiceNumbers::NONE,
+                                 firstAxis, first.diceNumber, alwaysSeven };
+  Outcome second = determineOutcome(secondInputs, simulatedRoll);
+  count(tally, first);
+  count(tally, second);
+  if (alwaysSeven || firstAxis == secondAxis) {
+    tally.pairs++;
+    if (onOppositeFaces(first.diceNumber, second.diceNumber)) {
+      tally.opposite++;
+    }
+  }
+  return second;
+}
+
+// A is entangled with B1 or B2 in turn and each round either die can measure first. The sister
+// inputs always come from the current partner; a result opposite to the previous partner only is stale
+static void simulateSwitching(OutcomeTally &tally, DiceNumbers previousPartner[2]) {
+  bool withB2 = generator() % 2;
+  DiceStates entangled = withB2 ? DiceStates::ENTANGLED_AB2 : DiceStates::ENTANGLED_AB1;
+  DiceStates unentangled = withB2 ? DiceStates::UN_ENTANGLED_AB2 : DiceStates::UN_ENTANGLED_AB1;
+  DiceNumbers stalePartner = previousPartner[!withB2];
+  MeasuredAxises firstAxis, secondAxis;
+  Outcome first;
+  Outcome second = measurePair(tally, entangled, unentangled, false, firstAxis, first, secondAxis);
+  bool aFirst = generator() % 2;
+  DiceNumbers a = aFirst ? first.diceNumber : second.diceNumber;
+  DiceNumbers partner = aFirst ? second.diceNumber : first.diceNumber;
+  if (firstAxis == secondAxis && stalePartner != DiceNumbers::NONE && onOppositeFaces(a, stalePartner)
+      && !onOppositeFaces(a, partner)) {
+    tally.stale++;
+  }
+  previousPartner[withB2] = partner;
+}
+
+static void runOutcomes(OutcomeTally *tally, uint64_t throws, uint32_t seed) {
+  generator.seed(seed);
+  DiceNumbers previousPartner[2] = { DiceNumbers::NONE, DiceNumbers::NONE };  //B1, B2
+  for (uint64_t i = 0; i < throws; i++) {
+    OutcomeInputs single = { DiceStates::SINGLE, randomAxis(), randomAxis(), DiceNumbers::NONE,
+                             MeasuredAxises::UNDEFINED, DiceNumbers::NONE, false };
+    count(tally[(uint8_t)OutcomeScenario::SINGLE], determineOutcome(single, simulatedRoll));
+
+    OutcomeInputs remeasure = { DiceStates::MEASURED, randomAxis(), randomAxis(), simulatedRoll(),
+                                MeasuredAxises::UNDEFINED, DiceNumbers::NONE, false };
+    count(tally[(uint8_t)OutcomeScenario::REMEASURE], determineOutcome(remeasure, simulatedRoll));
+
+    MeasuredAxises firstAxis, secondAxis;
+    Outcome first;
+    measurePair(tally[(uint8_t)OutcomeScenario::ENTANGLED], DiceStates::ENTANGLED_AB1, DiceStates::UN_ENTANGLED_AB1, false,
+                firstAxis, first, secondAxis);
+    measurePair(tally[(uint8_t)OutcomeScenario::ENTANGLED_SEVEN], DiceStates::ENTANGLED_AB1, DiceStates::UN_ENTANGLED_AB1, true,
+                firstAxis, first, secondAxis);
+
+    OutcomeInputs afterEnt = { DiceStates::MEASURED_AFTER_ENT, randomAxis(), randomAxis(), simulatedRoll(), randomAxis(),
+                               generator() % 2 ? simulatedRoll() : DiceNumbers::NONE, false };  //half of the sisters not measured
+    count(tally[(uint8_t)OutcomeScenario::AFTER_ENT], determineOutcome(afterEnt, simulatedRoll));
+
+    simulateSwitching(tally[(uint8_t)OutcomeScenario::SWITCHING], previousPartner);
+  }
+}
+
+int main(int argc, char **argv) {
+  uint64_t throws = argc > 1 ? strtoull(argv[1], nullptr, 10) : OUTCOME_DEFAULT_THROWS;
+  unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<std::vector<OutcomeTally>> tallies(threads, std::vector<OutcomeTally>((uint8_t)OutcomeScenario::COUNT, OutcomeTally{}));
+  std::vector<std::thread> workers;
+  std::random_device seeds;
+
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned t = 0; t < threads; t++) {
+    uint64_t share = throws / threads + (t < throws % threads ? 1 : 0);
+    workers.emplace_back(runOutcomes, tallies[t].data(), share, seeds());
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+  printf("outcome,scenario,throws,n1,n2,n3,n4,n5,n6,random,keep,opposite,copySister,unchanged,pairs,oppositeFaces,stale\n");
+  for (uint8_t scenario = 0; scenario < (uint8_t)OutcomeScenario::COUNT; scenario++) {
+    OutcomeTally total = {};
+    for (const auto &tally : tallies) {
+      const OutcomeTally &part = tally[scenario];
+      for (uint8_t i = 0; i < 6; i++) total.numbers[i] += part.numbers[i];
+      for (uint8_t i = 0; i < OUTCOME_RULES; i++) total.rules[i] += part.rules[i];
+      total.pairs += part.pairs;
+      total.opposite += part.opposite;
+      total.stale += part.stale;
+    }
+    printf("outcome,%s,%llu", scenarioName(scenario), (unsigned long long)throws);
+    for (uint64_t n : total.numbers) printf(",%llu", (unsigned long long)n);
+    for (uint64_t n : total.rules) printf(",%llu", (unsigned long long)n);
+    printf(",%llu,%llu,%llu\n", (unsigned long long)total.pairs, (unsigned long long)total.opposite, (unsigned long long)total.stale);
+  }
+  printf("outcome,done,%lld ms,%u threads\n", (long long)elapsed, threads);
+
+  // Exit status for scripts: entangled pairs must always show opposite faces
+  for (const OutcomeScenario scenario : { OutcomeScenario::ENTANGLED, OutcomeScenario::ENTANGLED_SEVEN, OutcomeScenario::SWITCHING }) {
+    uint64_t pairs = 0, opposite = 0, stale = 0;
+    for (const auto &tally : tallies) {
+      pairs += tally[(uint8_t)scenario].pairs;
+      opposite += tally[(uint8_t)scenario].opposite;
+      stale += tally[(uint8_t)scenario].stale;
+    }
+    if (pairs != opposite || stale) {
+      return 1;
+    }
+  }
+  return 0;
+}
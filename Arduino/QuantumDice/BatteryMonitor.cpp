@@ -0,0 +1,53 @@
+#define LOG_MODULE LOG_BATTERY
+#include "defines.h"
+#include "BatteryMonitor.h"
+#include "handyHelpers.h"
+#include "PowerManager.h"
+
+BatteryMonitor batteryMonitor;
+
+float BatteryMonitor::sample() const {
+  uint32_t sum = 0;
+  for (uint8_t i = 0; i < BATTERY_OVERSAMPLE; i++) {
+    sum += analogReadMilliVolts(hwPins.adc_pin);
+  }
+  return sum / (float)BATTERY_OVERSAMPLE / 1000.0f * 2.0f;  //ADC measures 50% of battery voltage by 50/50 voltage divider
+}
+
+void BatteryMonitor::update() {
+  unsigned long now = millis();
+  if (_valid && now - _lastSampleTime < BATTERY_SAMPLE_INTERVAL) {
+    return;
+  }
+  _lastSampleTime = now;
+  _rawVoltage = sample();
+
+  // A lighter load than ACTIVE raises the terminal voltage, correct it back
+  float compensated = _rawVoltage;
+  if (_rawVoltage >= BATTERY_USB_VOLTAGE) {
+    compensated -= (powerDraw(PowerTier::ACTIVE).total() - powerManager.currentDraw().total()) / 1000.0f * BATTERY_RESISTANCE;
+  }
+  // The filter starts over when a battery reading appears or disappears (USB only <-> battery), otherwise
+  // it would ramp up from 0 V through MINBATERYVOLTAGE and latch the low battery flag
+  bool sourceChanged = (_rawVoltage < BATTERY_USB_VOLTAGE) != (_voltage < BATTERY_USB_VOLTAGE);
+  _voltage = _valid && !sourceChanged ? _voltage + BATTERY_FILTER * (compensated - _voltage) : compensated;
+  _valid = true;
+  _sequence++;
+
+  if (onUsb()) {  //while on USB the voltage is 0
+    _low = false;
+  } else if (_voltage < MINBATERYVOLTAGE) {
+    _low = true;
+  } else if (_voltage > MINBATERYVOLTAGE + BATTERY_HYSTERESIS) {
+    _low = false;
+  }
+}
+
+float BatteryMonitor::stateOfCharge() const {
+  return mapFloat(_voltage, MINBATERYVOLTAGE, MAXBATERYVOLTAGE, 0.0, 100.0, true);
+}
+
+void BatteryMonitor::print(Print &out) const {
+  out.printf("battery %.2f V (measured %.2f V, load %.0f mA), %.0f%%%s%s\n", _voltage, _rawVoltage,
+             powerManager.currentDraw().total(), stateOfCharge(), _low ? ", low" : "", onUsb() ? ", USB" : "");
+}
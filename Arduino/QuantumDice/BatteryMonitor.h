@@ -0,0 +1,50 @@
+#ifndef BATTERYMONITOR_H_
+#define BATTERYMONITOR_H_
+
+// Battery monitor: samples the ADC at a low fixed rate with oversampling and an exponential filter, and
+// compensates the voltage for the load the power manager estimates: MIN/MAXBATERYVOLTAGE hold at the
+// ACTIVE load. The voltage, state of charge and
+// low battery flag are cached for the state handlers and the voltage indicator, which no longer read
+// the ADC themselves. The low battery flag has hysteresis so a noisy sample cannot toggle it.
+#include <Arduino.h>
+
+#define BATTERY_SAMPLE_INTERVAL 250    //ms between ADC bursts
+#define BATTERY_OVERSAMPLE 8           //ADC reads per burst, averaged
+#define BATTERY_FILTER 0.2f            //weight of a new burst in the filtered voltage
+#define BATTERY_RESISTANCE 0.15f       //ohm, cell and wiring, for the load compensation
+#define BATTERY_HYSTERESIS 0.05f       //V above MINBATERYVOLTAGE to clear the low battery flag
+#define BATTERY_USB_VOLTAGE 0.5f       //V, below this the die runs on USB without a battery reading
+
+class BatteryMonitor {
+public:
+  void update();  //once per loop, samples only every BATTERY_SAMPLE_INTERVAL
+
+  float voltage() const {  //filtered and load compensated, V
+    return _voltage;
+  }
+  float stateOfCharge() const;  //0..100 %
+  bool isLow() const {
+    return _low;
+  }
+  bool onUsb() const {
+    return _valid && _voltage < BATTERY_USB_VOLTAGE;
+  }
+  uint32_t sequence() const {  //increments with every burst, to redraw only on new values
+    return _sequence;
+  }
+  void print(Print &out) const;
+
+private:
+  float sample() const;
+
+  float _voltage = 0.0f;
+  float _rawVoltage = 0.0f;  //last burst, uncompensated
+  bool _valid = false;
+  bool _low = false;
+  uint32_t _sequence = 0;
+  unsigned long _lastSampleTime = 0;
+};
+
+extern BatteryMonitor batteryMonitor;
+
+#endif /* BATTERYMONITOR_H_ */
@@ -0,0 +1,115 @@
+#include "defines.h"
+#include "Benchmarks.h"
+#include <esp_cpu.h>
+#include "IMUhelpers.h"
+#include "Orientation.h"
+#include "DiceOutcome.h"
+#include "ScreenStateDefs.h"
+#include "Screenfunctions.h"
+#include "handyHelpers.h"
+#include "Messages.h"
+#include "EspNowSensor.h"
+#include "FrequencyGovernor.h"
+#include "MemoryBudget.h"
+
+#if DEV_TOOLS == 1
+
+static volatile uint32_t benchSink;  //keeps results alive
+
+// Gives the benchmarks access to the protected IMU kernels
+class BenchImuSensor : public IMUSensor {
+public:
+  void setGyro(float x, float y, float z) {
+    _xGyro = x;
+    _yGyro = y;
+    _zGyro = z;
+  }
+  void integrate(float deltaTime) {
+    updateUpVector(deltaTime);
+  }
+};
+
+template<typename Kernel>
+static void bench(Print &out, const char *name, uint32_t iterations, Kernel kernel) {
+  uint32_t allocations = loopTaskAllocations();
+  uint32_t start = esp_cpu_get_cycle_count();
+  for (uint32_t i = 0; i < iterations; i++) {
+    kernel(i);
+  }
+  uint32_t cycles = esp_cpu_get_cycle_count() - start;
+  allocations = loopTaskAllocations() - allocations;
+
+  float nsPerOp = cycles * 1000.0f / getCpuFrequencyMhz() / iterations;
+  if (allocationCounting()) {
+    out.printf("bench,%s,%lu,%.1f,%.3f\n", name, (unsigned long)iterations, nsPerOp, allocations / (float)iterations);
+  } else {
+    out.printf("bench,%s,%lu,%.1f,-\n", name, (unsigned long)iterations, nsPerOp);  //no allocation hook in this build
+  }
+}
+
+static DiceNumbers benchRoll() {
+  return DiceNumbers::THREE;  //fixed input instead of the ATECC
+}
+
+void runBenchmarks(Print &out) {
+  FrequencyBoost boost(false);  //cycle counts at a fixed frequency
+  out.printf("bench,name,iterations,ns_per_op,allocs_per_op  (cpu %lu MHz)\n", (unsigned long)getCpuFrequencyMhz());
+
+  BenchImuSensor *imu = new BenchImuSensor();  //holds the sample ring and recorder, too large for the stack
+  imu->reset();
+  imu->setGyro(0.3f, -0.2f, 0.1f);
+  bench(out, "imu.updateUpVector", 10000, [&](uint32_t) {
+    imu->integrate(0.01f);
+  });
+  bench(out, "imu.tumbled", 10000, [&](uint32_t) {
+    benchSink += imu->tumbled(0.45f);
+  });
+  bench(out, "imu.isMoving", 10000, [&](uint32_t) {
+    benchSink += imu->isMoving();
+  });
+  delete imu;
+
+  bench(out, "classifyOrientation", 10000, [&](uint32_t i) {
+    benchSink += (uint8_t)classifyOrientation(currentConfig.mounting, 0.3f, -9.7f, (i & 7) * 0.1f).upSide;
+  });
+  OutcomeInputs outcomeInputs = { DiceStates::ENTANGLED_AB1, MeasuredAxises::ZAXIS, MeasuredAxises::XAXIS, DiceNumbers::TWO,
+                                  MeasuredAxises::ZAXIS, DiceNumbers::FIVE, false };
+  bench(out, "determineOutcome", 10000, [&](uint32_t) {
+    benchSink += (uint8_t)determineOutcome(outcomeInputs, benchRoll).diceNumber;
+  });
+
+  bench(out, "blendColor", 10000, [&](uint32_t i) {
+    benchSink += blendColor(GC9A01A_WHITE, (uint16_t)i, (i & 15) / 15.0f);
+  });
+  selectScreens(NO_ONE);  //draw without changing what is shown
+  bench(out, "drawDot", 100, [&](uint32_t i) {
+    drawDot(120, 120, (i & 15) / 15.0f);
+  });
+  bench(out, "composeImage", 10, [&](uint32_t i) {
+    benchSink += composeImage(circleImage(), (uint16_t)i)[0];
+  });
+
+  ScreenStates x0, x1, y0, y1, z0, z1;
+  bench(out, "findValues", 10000, [&](uint32_t) {
+    benchSink += findValues(stateSelf, diceStateSelf, diceNumberSelf, upSideSelf, x0, x1, y0, y1, z0, z1);
+  });
+
+  RingBuffer<message, ESPNOW_QUEUE_SIZE> queue;  //as the ESP-NOW receive queue
+  message data = {};
+  data.type = MESSAGE_TYPE_MEASUREMENT;
+  bench(out, "queue.pushPop", 10000, [&](uint32_t) {
+    message popped;
+    queue.push(data);
+    queue.pop(&popped);
+    benchSink += popped.type;
+  });
+  uint8_t encoded[sizeof(message)];
+  bench(out, "message.encodeDecode", 10000, [&](uint32_t i) {
+    data.data.measurement.diceNumber = (DiceNumbers)(i % 6 + 1);
+    memcpy(encoded, &data, sizeof(message));
+    message decoded;
+    memcpy(&decoded, encoded, sizeof(message));
+    benchSink += (uint8_t)decoded.data.measurement.diceNumber;
+  });
+}
+#endif
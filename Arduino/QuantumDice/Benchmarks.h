@@ -0,0 +1,11 @@
+#ifndef BENCHMARKS_H_
+#define BENCHMARKS_H_
+
+// Microbenchmarks of the firmware hot paths with fixed inputs, run on the die by the "bench" serial command (DEV_TOOLS).
+// One CSV line per kernel: bench,<name>,<iterations>,<ns per op>,<loop task allocations per op>
+// The allocation column needs ALLOCATION_CHECK 1 with the heap hook (MemoryBudget.h) and is - otherwise
+#include <Arduino.h>
+
+void runBenchmarks(Print &out);
+
+#endif /* BENCHMARKS_H_ */
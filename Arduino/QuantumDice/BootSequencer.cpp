@@ -0,0 +1,90 @@
+#include "defines.h"
+#include "BootSequencer.h"
+#include <esp_timer.h>
+#include <freertos/event_groups.h>
+
+struct BootTask {
+  BootStage stage;
+  void (*function)(void *);
+  void *parameter;
+};
+
+static int64_t stageStart[(uint8_t)BootStage::COUNT];  //us since power on, 0 is not run
+static int64_t stageEnd[(uint8_t)BootStage::COUNT];
+static int64_t readyTime = 0;
+static bool warmBoot = false;
+static BootTask bootTasks[(uint8_t)BootStage::COUNT];
+static StaticEventGroup_t doneGroupBuffer;
+static EventGroupHandle_t doneGroup = nullptr;  //one bit per ended stage
+
+static const char *stageName(BootStage stage) {
+  switch (stage) {
+    case BootStage::SERIAL_PORT: return "serial";
+    case BootStage::CONFIG: return "config";
+    case BootStage::DISPLAYS: return "displays";
+    case BootStage::IMU: return "imu";
+    case BootStage::RADIO: return "radio";
+    case BootStage::RANDOM: return "random";
+    case BootStage::STATE_MACHINE: return "statemachine";
+    default: return "?";
+  }
+}
+
+static EventGroupHandle_t getDoneGroup() {
+  if (!doneGroup) {
+    doneGroup = xEventGroupCreateStatic(&doneGroupBuffer);  //first call is in setup(), before any boot task
+  }
+  return doneGroup;
+}
+
+void bootBegin(BootStage stage) {
+  stageStart[(uint8_t)stage] = esp_timer_get_time();
+}
+
+void bootEnd(BootStage stage) {
+  stageEnd[(uint8_t)stage] = esp_timer_get_time();
+  xEventGroupSetBits(getDoneGroup(), 1 << (uint8_t)stage);
+}
+
+static void bootTask(void *parameter) {
+  BootTask *task = (BootTask *)parameter;
+  task->function(task->parameter);
+  bootEnd(task->stage);
+  vTaskDelete(nullptr);
+}
+
+void bootStartTask(BootStage stage, void (*function)(void *), void *parameter) {
+  getDoneGroup();
+  bootBegin(stage);
+  BootTask &task = bootTasks[(uint8_t)stage];
+  task = { stage, function, parameter };
+  if (xTaskCreatePinnedToCore(bootTask, stageName(stage), BOOT_TASK_STACK, &task, BOOT_TASK_PRIORITY, nullptr, BOOT_TASK_CORE) != pdPASS) {
+    debugln("boot task not started, running inline");
+    function(parameter);
+    bootEnd(stage);
+  }
+}
+
+void bootWait(BootStage stage) {
+  EventBits_t bit = 1 << (uint8_t)stage;
+  xEventGroupWaitBits(getDoneGroup(), bit, pdFALSE, pdTRUE, portMAX_DELAY);
+}
+
+void bootReady(bool warm) {
+  readyTime = esp_timer_get_time();
+  warmBoot = warm;
+}
+
+// boot,<stage>,<start ms>,<duration ms>, boot,ready,<ms>,cold|warm since power on or wake and
+// boot,target,<ms>,ok|over against BOOT_TARGET_TIME
+void printBootTimes(Print &out) {
+  for (uint8_t i = 0; i < (uint8_t)BootStage::COUNT; i++) {
+    if (stageEnd[i] == 0) {
+      continue;
+    }
+    out.printf("boot,%s,%lu,%lu\n", stageName((BootStage)i), (unsigned long)(stageStart[i] / 1000),
+               (unsigned long)((stageEnd[i] - stageStart[i]) / 1000));
+  }
+  out.printf("boot,ready,%lu,%s\n", (unsigned long)(readyTime / 1000), warmBoot ? "warm" : "cold");
+  out.printf("boot,target,%u,%s\n", BOOT_TARGET_TIME, readyTime / 1000 <= BOOT_TARGET_TIME ? "ok" : "over");
+}
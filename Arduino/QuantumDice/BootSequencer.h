@@ -0,0 +1,32 @@
+#ifndef BOOTSEQUENCER_H_
+#define BOOTSEQUENCER_H_
+
+// Staged boot: independent peripherals start in their own task while setup() continues, later stages
+// wait for the ones they depend on instead of sleeping a fixed time. Each stage records its start and
+// end time since power on; printBootTimes() reports them (serial command "boot").
+#include <Arduino.h>
+
+#define BOOT_TASK_STACK 4096
+#define BOOT_TASK_PRIORITY 1  //below the IMU sampler
+#define BOOT_TASK_CORE 0      //setup() runs on core 1
+#define BOOT_TARGET_TIME 1000 //ms from power on to the end of setup(), checked in printBootTimes()
+
+enum class BootStage : uint8_t {
+  SERIAL_PORT,
+  CONFIG,
+  DISPLAYS,   //SPI, in setup()
+  IMU,        //I2C, own task
+  RADIO,      //WiFi start, own task
+  RANDOM,     //ATECC, after IMU: same I2C bus
+  STATE_MACHINE,
+  COUNT
+};
+
+void bootBegin(BootStage stage);
+void bootEnd(BootStage stage);
+void bootStartTask(BootStage stage, void (*function)(void *), void *parameter);  //stage ends when function returns
+void bootWait(BootStage stage);  //until the stage has ended
+void bootReady(bool warm);       //end of setup(), warm: resumed from a warm sleep (WarmSleep.h)
+void printBootTimes(Print &out);
+
+#endif /* BOOTSEQUENCER_H_ */
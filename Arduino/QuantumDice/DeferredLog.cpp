@@ -0,0 +1,182 @@
+#include "defines.h"
+#include "DeferredLog.h"
+
+DeferredLog deferredLog;
+ConsoleOutput consoleOut;
+volatile uint8_t logModulesEnabled = LOG_MODULES_COMPILED;
+
+const char *logModuleName(uint8_t module) {
+  switch (module) {
+    case LOG_MAIN: return "main";
+    case LOG_STATE: return "state";
+    case LOG_IMU: return "imu";
+    case LOG_SCREEN: return "screen";
+    case LOG_I2C: return "i2c";
+    case LOG_POWER: return "power";
+    case LOG_BATTERY: return "battery";
+    case LOG_PROF: return "prof";
+    default: return "?";
+  }
+}
+
+DeferredLog::DeferredLog() {
+  for (uint32_t i = 0; i < LOG_RECORD_SLOTS; i++) {
+    _records[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+void DeferredLog::begin() {
+  _lock = xSemaphoreCreateMutex();
+  _buffer = xStreamBufferCreate(LOG_BUFFER_SIZE, 1);
+  if (!_lock || !_buffer || xTaskCreatePinnedToCore(drainTask, "logDrain", LOG_DRAIN_STACK, this, LOG_DRAIN_PRIORITY, NULL, LOG_DRAIN_CORE) != pdPASS) {
+    Serial.println("ERROR: deferred log not started, debug output stays synchronous");
+    _buffer = nullptr;
+  }
+}
+
+size_t DeferredLog::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t DeferredLog::write(const uint8_t *buffer, size_t size) {
+  return append(buffer, size, 0);  //never wait for the drain task
+}
+
+// The line of the calling task, or a free slot for it
+LogLine *DeferredLog::claimLine() {
+  TaskHandle_t task = xTaskGetCurrentTaskHandle();
+  LogLine *claimed = nullptr;
+  portENTER_CRITICAL(&_linesLock);
+  for (LogLine &line : _lines) {
+    if (line.owner == task) {
+      claimed = &line;
+      break;
+    }
+    if (!line.owner && !claimed) {
+      claimed = &line;
+    }
+  }
+  if (claimed) {
+    claimed->owner = task;
+  }
+  portEXIT_CRITICAL(&_linesLock);
+  return claimed;
+}
+
+void DeferredLog::releaseLine(LogLine *line) {
+  portENTER_CRITICAL(&_linesLock);
+  line->owner = nullptr;
+  portEXIT_CRITICAL(&_linesLock);
+}
+
+void DeferredLog::send(const uint8_t *buffer, size_t size, TickType_t wait) {
+  xSemaphoreTake(_lock, portMAX_DELAY);
+  size_t written = xStreamBufferSend(_buffer, buffer, size, wait);
+  xSemaphoreGive(_lock);
+  if (written < size) {
+    _dropped += size - written;
+  }
+}
+
+// Only the owning task touches its line, so appending needs no lock; the mutex is taken once per line
+size_t DeferredLog::append(const uint8_t *buffer, size_t size, TickType_t wait) {
+  if (!_buffer) {
+    return Serial.write(buffer, size);
+  }
+  LogLine *line = claimLine();
+  if (!line) {
+    send(buffer, size, wait);
+    return size;
+  }
+  for (size_t i = 0; i < size; i++) {
+    line->text[line->length++] = buffer[i];
+    if (buffer[i] == '\n' || line->length == LOG_LINE_LENGTH) {
+      send(line->text, line->length, wait);
+      line->length = 0;
+    }
+  }
+  if (line->length == 0) {
+    releaseLine(line);
+  }
+  return size;
+}
+
+// Bounded multi producer queue: a producer claims a position with one compare and swap, fills the slot
+// and publishes it through the slot's sequence. A full ring drops the record, nothing waits
+void DeferredLog::pushRecord(const LogRecord &record) {
+  if (!_buffer) {  //before begin(): synchronous, like the text output
+    writeRecord(record);
+    return;
+  }
+  uint32_t position = _recordTail.load(std::memory_order_relaxed);
+  LogRecordSlot *slot;
+  for (;;) {
+    slot = &_records[position % LOG_RECORD_SLOTS];
+    int32_t lag = (int32_t)(slot->sequence.load(std::memory_order_acquire) - position);
+    if (lag == 0) {
+      if (_recordTail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (lag < 0) {  //not read yet since the last round
+      _droppedRecords.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      position = _recordTail.load(std::memory_order_relaxed);
+    }
+  }
+  slot->record = record;
+  slot->sequence.store(position + 1, std::memory_order_release);
+}
+
+bool DeferredLog::popRecord(LogRecord &record) {
+  LogRecordSlot &slot = _records[_recordHead % LOG_RECORD_SLOTS];
+  if (slot.sequence.load(std::memory_order_acquire) != _recordHead + 1) {
+    return false;
+  }
+  record = slot.record;
+  slot.sequence.store(_recordHead + LOG_RECORD_SLOTS, std::memory_order_release);
+  _recordHead++;
+  return true;
+}
+
+void DeferredLog::writeRecord(const LogRecord &record) {
+#if LOG_BINARY == 1
+  uint8_t frame[3 + 4 * LOG_RECORD_ARGS] = { LOG_RECORD_MARKER, record.format, record.argCount };
+  uint8_t length = 3;
+  for (uint8_t i = 0; i < record.argCount; i++) {
+    for (uint8_t shift = 0; shift < 32; shift += 8) {
+      frame[length++] = record.args[i] >> shift;
+    }
+  }
+  Serial.write(frame, length);
+#else
+  char text[160];
+  size_t length = expandLogRecord(record, text, sizeof(text));
+  Serial.write((const uint8_t *)text, length);
+  Serial.write('\n');
+#endif
+}
+
+void DeferredLog::drainTask(void *parameter) {
+  DeferredLog *log = (DeferredLog *)parameter;
+  uint8_t chunk[64];
+  unsigned long reportedDropped = 0;
+  unsigned long reportedRecords = 0;
+  LogRecord record;
+  for (;;) {
+    size_t length = xStreamBufferReceive(log->_buffer, chunk, sizeof(chunk), pdMS_TO_TICKS(LOG_RECORD_POLL));
+    while (log->popRecord(record)) {
+      log->writeRecord(record);
+    }
+    Serial.write(chunk, length);
+    if (log->_dropped != reportedDropped) {
+      reportedDropped = log->_dropped;
+      Serial.printf("\n[log: %lu bytes dropped]\n", reportedDropped);
+    }
+    unsigned long droppedRecords = log->_droppedRecords.load(std::memory_order_relaxed);
+    if (droppedRecords != reportedRecords) {
+      reportedRecords = droppedRecords;
+      Serial.printf("\n[log: %lu records dropped]\n", reportedRecords);
+    }
+  }
+}
@@ -0,0 +1,101 @@
+#ifndef DEFERREDLOG_H_
+#define DEFERREDLOG_H_
+
+// Deferred debug output: debug()/debugln() format into a RAM stream buffer and a low priority task
+// writes it to Serial, so the state machine and render paths never wait for the UART.
+// Text is collected per task until the end of the line, so lines of different tasks do not mix.
+// Task context only, not for ISRs. Output is dropped (and counted) when the buffer is full.
+// Serial command replies go through the same buffer with consoleOut, which waits instead of dropping.
+// Hot paths log binary records instead (debugRecord(), LogRecords.h): a format ID and raw arguments in a
+// lock free ring, formatted by the drain task, or sent as binary frames for the host decoder with LOG_BINARY.
+// Records and text lines are drained separately, so they can swap places within LOG_RECORD_POLL.
+#include <Arduino.h>
+#include <atomic>
+#include <freertos/stream_buffer.h>
+#include "LogRecords.h"
+
+#define LOG_BUFFER_SIZE 4096
+#define LOG_DRAIN_STACK 3072
+#define LOG_DRAIN_PRIORITY 1  //below the IMU sampler
+#define LOG_DRAIN_CORE 0      //loop() runs on core 1 and never yields
+#define LOG_MODULE_COUNT 8
+#define LOG_LINE_LENGTH 120   //longer lines are sent in pieces
+#define LOG_LINE_SLOTS 4      //tasks with an unfinished line at the same time, others write unbuffered
+#define LOG_RECORD_SLOTS 32   //power of two, binary records waiting for the drain task
+#define LOG_RECORD_POLL 10    //ms, longest wait of a record while no text arrives
+
+struct LogLine {
+  TaskHandle_t owner;  //nullptr when free
+  uint8_t length;
+  uint8_t text[LOG_LINE_LENGTH];
+};
+
+// Slot of the record ring. sequence == position: free for the producer at that position,
+// position + 1: filled, position + LOG_RECORD_SLOTS: read, free for the next round
+struct LogRecordSlot {
+  std::atomic<uint32_t> sequence;
+  LogRecord record;
+};
+
+class DeferredLog : public Print {
+public:
+  DeferredLog();
+  void begin();  //after Serial.begin(). Until then output goes straight to Serial
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t *buffer, size_t size) override;
+  size_t append(const uint8_t *buffer, size_t size, TickType_t wait);  //wait: ticks for buffer space
+  unsigned long getDropped() const {
+    return _dropped;
+  }
+
+  template <typename... Args>
+  void record(LogFormat format, Args... args) {  //any task, never blocks
+    static_assert(sizeof...(Args) <= LOG_RECORD_ARGS, "too many log record arguments");
+    LogRecord entry = { (uint8_t)format, (uint8_t)sizeof...(Args), { logWord(args)... } };
+    pushRecord(entry);
+  }
+
+private:
+  static void drainTask(void *parameter);
+  LogLine *claimLine();
+  void releaseLine(LogLine *line);
+  void send(const uint8_t *buffer, size_t size, TickType_t wait);
+  void pushRecord(const LogRecord &record);
+  bool popRecord(LogRecord &record);  //drain task only
+  void writeRecord(const LogRecord &record);
+
+  StreamBufferHandle_t _buffer = nullptr;
+  SemaphoreHandle_t _lock = nullptr;  //stream buffers allow one writer at a time
+  volatile unsigned long _dropped = 0;
+  LogLine _lines[LOG_LINE_SLOTS] = {};
+  portMUX_TYPE _linesLock = portMUX_INITIALIZER_UNLOCKED;
+
+  LogRecordSlot _records[LOG_RECORD_SLOTS];
+  std::atomic<uint32_t> _recordTail{ 0 };  //next position to claim, producers
+  uint32_t _recordHead = 0;                //next position to read, drain task
+  std::atomic<unsigned long> _droppedRecords{ 0 };
+};
+
+extern DeferredLog deferredLog;
+
+// Serial command and error replies: in order with the debug output, never dropped
+class ConsoleOutput : public Print {
+public:
+  size_t write(uint8_t c) override {
+    return write(&c, 1);
+  }
+  size_t write(const uint8_t *buffer, size_t size) override {
+    return deferredLog.append(buffer, size, portMAX_DELAY);
+  }
+};
+
+extern ConsoleOutput consoleOut;
+
+// Runtime switch per log module, bit LOG_MAIN .. LOG_SCREEN (see defines.h)
+extern volatile uint8_t logModulesEnabled;
+inline bool logEnabled(uint8_t module) {
+  return logModulesEnabled & (1 << module);
+}
+const char *logModuleName(uint8_t module);
+
+#endif /* DEFERREDLOG_H_ */
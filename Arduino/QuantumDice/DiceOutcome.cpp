@@ -0,0 +1,66 @@
+#include "DiceOutcome.h"
+
+DiceNumbers oppositeDiceNumber(DiceNumbers diceNumber) {
+  switch (diceNumber) {
+    case DiceNumbers::ONE: return DiceNumbers::SIX;
+    case DiceNumbers::TWO: return DiceNumbers::FIVE;
+    case DiceNumbers::THREE: return DiceNumbers::FOUR;
+    case DiceNumbers::FOUR: return DiceNumbers::THREE;
+    case DiceNumbers::FIVE: return DiceNumbers::TWO;
+    case DiceNumbers::SIX: return DiceNumbers::ONE;
+    default: return DiceNumbers::NONE;
+  }
+}
+
+// Entangled dice: opposite number (sum 7) when the sister already measured, otherwise random.
+// alwaysSeven: any axis of the sister counts. Otherwise only the same axis.
+static Outcome entangledOutcome(const OutcomeInputs &in, DiceRollFunction rollOneToSix) {
+  bool sisterReady = in.alwaysSeven ? (in.measureAxisSister != MeasuredAxises::UNDEFINED)
+                                    : (in.measureAxis == in.measureAxisSister);
+  if (sisterReady) {
+    DiceNumbers opposite = oppositeDiceNumber(in.diceNumberSister);
+    if (opposite != DiceNumbers::NONE) {
+      return { opposite, OutcomeRule::OPPOSITE };
+    }
+  }
+  return { rollOneToSix(), OutcomeRule::RANDOM };
+}
+
+Outcome determineOutcome(const OutcomeInputs &in, DiceRollFunction rollOneToSix) {
+  switch (in.diceState) {
+    case DiceStates::SINGLE:
+      return { rollOneToSix(), OutcomeRule::RANDOM };
+
+    case DiceStates::MEASURED:  // 2 options: same measureAxis or different measureAxis
+      if (in.measureAxis != in.prevMeasureAxis) {
+        return { rollOneToSix(), OutcomeRule::RANDOM };
+      }
+      return { in.prevDiceNumber, OutcomeRule::KEEP };
+
+    case DiceStates::ENTANGLED_AB1:
+    case DiceStates::UN_ENTANGLED_AB1:
+    case DiceStates::ENTANGLED_AB2:
+    case DiceStates::UN_ENTANGLED_AB2:
+      return entangledOutcome(in, rollOneToSix);
+
+    case DiceStates::MEASURED_AFTER_ENT:  // 2 options: no sister diceNumber or with diceNumber
+      if (in.diceNumberSister == DiceNumbers::NONE) {
+        return { rollOneToSix(), OutcomeRule::RANDOM };
+      }
+      return { in.diceNumberSister, OutcomeRule::COPY_SISTER };
+
+    default:
+      return { in.prevDiceNumber, OutcomeRule::UNCHANGED };
+  }
+}
+
+const char *outcomeRuleName(OutcomeRule rule) {
+  switch (rule) {
+    case OutcomeRule::RANDOM: return "RANDOM";
+    case OutcomeRule::KEEP: return "KEEP";
+    case OutcomeRule::OPPOSITE: return "OPPOSITE";
+    case OutcomeRule::COPY_SISTER: return "COPY_SISTER";
+    case OutcomeRule::UNCHANGED: return "UNCHANGED";
+  }
+  return "?";
+}
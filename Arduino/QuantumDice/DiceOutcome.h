@@ -0,0 +1,41 @@
+#ifndef DICEOUTCOME_H_
+#define DICEOUTCOME_H_
+
+// Pure outcome engine: the "secret sauce" that decides the number on top after a measurement.
+// No I/O, no globals and no hardware access, so the same code runs in the firmware and in the host Monte Carlo
+// simulator (../HostTools/OutcomeSimulator.cpp) with any random source.
+#include "DiceTypes.h"
+
+// Everything the secret sauce looks at, captured at the moment of measurement
+struct OutcomeInputs {
+  DiceStates diceState;              // diceState before the measurement (SINGLE, MEASURED, ENTANGLED_AB1, ...)
+  MeasuredAxises measureAxis;        // axis just measured
+  MeasuredAxises prevMeasureAxis;    // axis of the previous measurement
+  DiceNumbers prevDiceNumber;        // number currently on top, kept when measured again along the same axis
+  MeasuredAxises measureAxisSister;  // axis measured by the entangled sister, UNDEFINED when not measured yet
+  DiceNumbers diceNumberSister;      // number measured by the sister, NONE when not measured yet
+  bool alwaysSeven;                  // currentConfig.alwaysSeven
+};
+
+// Which rule of the secret sauce produced the number
+enum class OutcomeRule : uint8_t {
+  RANDOM,       // fresh random 1..6
+  KEEP,         // same axis as before, number unchanged
+  OPPOSITE,     // entangled, sister measured: sum is 7
+  COPY_SISTER,  // measured after entanglement: take over the sister number
+  UNCHANGED     // diceState has no rule, number untouched
+};
+
+struct Outcome {
+  DiceNumbers diceNumber;
+  OutcomeRule rule;
+};
+
+// Random source returning DiceNumbers::ONE .. DiceNumbers::SIX. Firmware uses selectOneToSix()
+typedef DiceNumbers (*DiceRollFunction)();
+
+Outcome determineOutcome(const OutcomeInputs &inputs, DiceRollFunction rollOneToSix);
+DiceNumbers oppositeDiceNumber(DiceNumbers diceNumber);  //1<->6, 2<->5, 3<->4. Other values return NONE
+const char *outcomeRuleName(OutcomeRule rule);
+
+#endif /* DICEOUTCOME_H_ */
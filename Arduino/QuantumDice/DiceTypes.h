@@ -0,0 +1,72 @@
+#ifndef DICETYPES_H_
+#define DICETYPES_H_
+
+// Dice enums shared by the state machine, the screens and the pure code (DiceOutcome.h, Orientation.h, LogRecords.h).
+// No Arduino or firmware includes, so the pure code also builds on a host.
+#include <stdint.h>
+
+enum class State {
+  IDLE,
+  INITSINGLE,
+  INITENTANGLED_AB1,
+  WAITFORTHROW,
+  THROWING,
+  INITMEASURED,
+  LOWBATTERY,
+  CLASSIC_STATE,
+  INITENTANGLED_AB2,
+  INITSINGLE_AFTER_ENT,
+  COUNT  //number of states, not a state
+};
+
+enum class DiceStates : uint8_t {
+  SINGLE,
+  ENTANGLED_AB1,
+  ENTANGLED_AB2,
+  UN_ENTANGLED_AB1,
+  UN_ENTANGLED_AB2,
+  MEASURED,
+  MEASURED_AFTER_ENT,
+  ALL,
+  NONE,
+  CLASSIC,
+  ANY,
+  NA
+};
+
+enum class DiceNumbers : uint8_t {
+  NONE,
+  ONE,
+  TWO,
+  THREE,
+  FOUR,
+  FIVE,
+  SIX,
+  CROSS,
+  CIRCLE,
+  ANY,
+  NA
+};
+
+enum class MeasuredAxises : uint8_t {
+  UNDEFINED,
+  XAXIS,
+  YAXIS,
+  ZAXIS,
+  ALL,
+  NA  //not applicable
+};
+
+enum class UpSide : uint8_t {
+  NONE,
+  X0,
+  X1,
+  Y0,
+  Y1,
+  Z0,
+  Z1,
+  ANY,
+  NA
+};
+
+#endif /* DICETYPES_H_ */
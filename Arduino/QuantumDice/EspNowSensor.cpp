@@ -0,0 +1,45 @@
+#include "EspNowSensor.h"
+
+template<>
+void HOT_PATH EspNowSensor<message>::OnDataRecv(const esp_now_recv_info_t *mac, const unsigned char*incomingData, int len)
+{
+  assert(instance);
+  instance->onDataRecv(mac, incomingData, len);
+}
+
+template<>
+void HOT_PATH EspNowSensor<message>::onDataRecv(const esp_now_recv_info_t *mac, const unsigned char*incomingData, int len)
+{
+  TRACE_INSTANT(ESPNOW_RECEIVE, 0);
+  if (len != sizeof(message) || incomingData[offsetof(message, version)] != MESSAGE_VERSION) {
+    return;  //other firmware or a stray frame, never read past the radio buffer
+  }
+  message received;
+  memcpy(&received, incomingData, sizeof(message));
+  _messageQueue.push(received);  //dropped when the loop is 16 messages behind
+}
+
+template<>
+void HOT_PATH EspNowSensor<message>::PromiscuousRxCb(void *buf, wifi_promiscuous_pkt_type_t type)
+{
+  assert(instance);
+  instance->promiscuousRxCb(buf, type);
+}
+
+template<>
+void HOT_PATH EspNowSensor<message>::promiscuousRxCb(void *buf, wifi_promiscuous_pkt_type_t type)
+{
+  if (type != WIFI_PKT_MGMT)
+    return;
+
+  const wifi_promiscuous_pkt_t *ppkt = (wifi_promiscuous_pkt_t *)buf;
+  const wifi_ieee80211_packet_t *ipkt = (wifi_ieee80211_packet_t *)ppkt->payload;
+  const wifi_ieee80211_mac_hdr_t *hdr = &ipkt->hdr;
+  for (size_t i = 0; i < 6; i++) {
+    if (hdr->addr2[i] != _rssiCmpAddr[i]) {
+      return;
+    }
+
+    _rssi = ppkt->rx_ctrl.rssi;
+  }
+}
@@ -2,6 +2,8 @@
 #define ESPNOWSENSOR_H_
 
 #define ESPNOW_WIFI_CHANNEL 6
+#define ESPNOW_INIT_TIMEOUT 1000  //ms for the Wi-Fi driver to start
+#define ESPNOW_QUEUE_SIZE 17      //received messages waiting for the loop, ring capacity 16
 
 #include <sys/_stdint.h>
 #include <assert.h>
@@ -9,8 +11,10 @@
 #include <esp_now.h>
 #include <WiFi.h>
 #include "defines.h"
-#include "Queue.h"
+#include "RingBuffer.h"
+#include "TracePoints.h"
 #include "handyHelpers.h"  // Include for currentConfig access
+#include "Messages.h"
 
 template <typename T>
 class EspNowSensor
@@ -36,11 +40,7 @@ private:
   void promiscuousRxCb(void *buf, wifi_promiscuous_pkt_type_t type);
 
 private:
-  static void OnDataRecv(const esp_now_recv_info_t *mac, const unsigned char*incomingData, int len)
-  {
-    assert(instance);
-    instance->onDataRecv(mac, incomingData, len);
-  }
+  static void OnDataRecv(const esp_now_recv_info_t *mac, const unsigned char*incomingData, int len);
 
   static void OnDataSend(const wifi_tx_info_t *tx_info, esp_now_send_status_t status)
   {
@@ -48,12 +48,19 @@ private:
     instance->onDataSend(tx_info, status);
   }
 
-  static void PromiscuousRxCb(void *buf, wifi_promiscuous_pkt_type_t type)
+  static void PromiscuousRxCb(void *buf, wifi_promiscuous_pkt_type_t type);
+public:
+  // Registered receive callbacks, for the IRAM placement check of the self test
+  static const void *ReceiveCallback()
   {
-    assert(instance);
-    instance->promiscuousRxCb(buf, type);
+    return (const void *)&OnDataRecv;
   }
-public:
+
+  static const void *RssiCallback()
+  {
+    return (const void *)&PromiscuousRxCb;
+  }
+
   static void Init(uint8_t *rssiCompareAddr)
   {
     // Should only be initialized once
@@ -98,9 +105,9 @@ public:
   }
   
 private:
-  Queue<T> _messageQueue;
+  RingBuffer<T, ESPNOW_QUEUE_SIZE> _messageQueue;  //Wi-Fi task to loop, no allocation per message
 
-  uint8_t *_rssiCmpAddr;
+  uint8_t _rssiCmpAddr[6];
   int _rssi;
 };
 
@@ -129,14 +136,17 @@ EspNowSensor<T> *EspNowSensor<T>::instance = 0;
 template<typename T>
 void EspNowSensor<T>::init(uint8_t *rssiCompareAddr)
 {
-  _rssiCmpAddr = (uint8_t*)malloc(6 * sizeof(uint8_t));
-  memcpy(_rssiCmpAddr, rssiCompareAddr, 6 * sizeof(uint8_t));
+  memcpy(_rssiCmpAddr, rssiCompareAddr, sizeof(_rssiCmpAddr));
 
-  // Initialize the Wi-Fi module
+  // Initialize the Wi-Fi module, no-op when already started during boot
   WiFi.mode(WIFI_STA);
-  delay(1000);  // Give WiFi time to initialize
 
-  esp_err_t result = esp_now_init();
+  // ESP-NOW needs a started Wi-Fi driver: retry until it is instead of waiting a fixed time
+  unsigned long start = millis();
+  esp_err_t result;
+  while ((result = esp_now_init()) != ESP_OK && millis() - start < ESPNOW_INIT_TIMEOUT) {
+    delay(10);
+  }
   if (result != ESP_OK) {
     Serial.print("Error initializing ESP-NOW, error code: ");
     Serial.println(result);
@@ -203,32 +213,16 @@ bool EspNowSensor<T>::isCloseBy()
 template<typename T>
 bool EspNowSensor<T>::send(T message, uint8_t *target)
 {
-  T* toSend = (T*)malloc(sizeof(T));
-  if (!toSend)
-    return false;
-
-  memcpy(toSend, &message, sizeof(T));
-  
-  esp_err_t result = esp_now_send(target, (uint8_t *)toSend, sizeof(T));
+  TRACE_SCOPE(ESPNOW_SEND, 0);
+  // esp_now_send() copies the data before it returns
+  esp_err_t result = esp_now_send(target, (uint8_t *)&message, sizeof(T));
   return (result == ESP_OK);
 }
 
 template<typename T>
 bool EspNowSensor<T>::poll(T* message)
 {
-  if (_messageQueue.isEmpty())
-    return false;
-
-  *message = _messageQueue.pop();
-  return true;
-}
-
-template<typename T>
-void EspNowSensor<T>::onDataRecv(const esp_now_recv_info_t *mac, const unsigned char*incomingData, int len)
-{
-  T message;
-  memcpy(&message, incomingData, sizeof(T));
-  _messageQueue.push(message);
+  return _messageQueue.pop(message);
 }
 
 template<typename T>
@@ -247,22 +241,16 @@ void EspNowSensor<T>::onDataSend(const wifi_tx_info_t *tx_info, esp_now_send_sta
   // tx_info->tx_status - transmission status (alternative to 'status' parameter)
 }
 
-template<typename T>
-void EspNowSensor<T>::promiscuousRxCb(void *buf, wifi_promiscuous_pkt_type_t type)
-{
-  if (type != WIFI_PKT_MGMT)
-    return;
-
-  const wifi_promiscuous_pkt_t *ppkt = (wifi_promiscuous_pkt_t *)buf;
-  const wifi_ieee80211_packet_t *ipkt = (wifi_ieee80211_packet_t *)ppkt->payload;
-  const wifi_ieee80211_mac_hdr_t *hdr = &ipkt->hdr;
-  for (size_t i = 0; i < 6; i++) {
-    if (hdr->addr2[i] != _rssiCmpAddr[i]) {
-      return;
-    }
-
-    _rssi = ppkt->rx_ctrl.rssi;
-  }
-}
+// The receive path runs in the Wi-Fi task for every frame and is placed in IRAM (HOT_PATH). The section
+// attribute is ignored on implicit template instantiations, so it is defined for the message type in
+// EspNowSensor.cpp
+template<>
+void EspNowSensor<message>::OnDataRecv(const esp_now_recv_info_t *mac, const unsigned char*incomingData, int len);
+template<>
+void EspNowSensor<message>::onDataRecv(const esp_now_recv_info_t *mac, const unsigned char*incomingData, int len);
+template<>
+void EspNowSensor<message>::PromiscuousRxCb(void *buf, wifi_promiscuous_pkt_type_t type);
+template<>
+void EspNowSensor<message>::promiscuousRxCb(void *buf, wifi_promiscuous_pkt_type_t type);
 
 #endif /* ESPNOWSENSOR_H_ */
\ No newline at end of file
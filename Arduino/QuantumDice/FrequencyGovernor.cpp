@@ -0,0 +1,123 @@
+#define LOG_MODULE LOG_POWER
+#include "defines.h"
+#include "FrequencyGovernor.h"
+#include "esp_timer.h"
+#include <limits.h>
+#include "BatteryMonitor.h"
+#include "PowerManager.h"
+
+FrequencyGovernor governor;
+
+void FrequencyGovernor::begin() {
+  _maxMhz = getCpuFrequencyMhz();
+  _stateSince = esp_timer_get_time();
+#if GOVERNOR == 1
+  esp_pm_config_t config = {};
+  config.max_freq_mhz = _maxMhz;
+  config.min_freq_mhz = GOVERNOR_LOW_MHZ;
+  config.light_sleep_enable = false;
+  if (esp_pm_configure(&config) != ESP_OK || esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "governor", &_lock) != ESP_OK) {
+    debugln("governor: power management not available, full clock");
+    return;
+  }
+  _enabled = true;
+  acquire();  //the boot render is still running, drop after the hold time
+  _releaseTime = millis();
+#endif
+}
+
+unsigned long FrequencyGovernor::holdTime() const {
+  if (batteryMonitor.onUsb()) {
+    return ULONG_MAX;
+  }
+  return GOVERNOR_HOLD_TIME * batteryMonitor.stateOfCharge() / 100;
+}
+
+void FrequencyGovernor::acquire() {
+  int64_t start = esp_timer_get_time();
+  esp_pm_lock_acquire(_lock);
+  int64_t now = esp_timer_get_time();
+  uint32_t switchTime = now - start;
+  _switches++;
+  _switchTime += switchTime;
+  _maxSwitchTime = max(_maxSwitchTime, switchTime);
+  _lowTime += now - _stateSince;
+  _stateSince = now;
+  _held = true;
+}
+
+void FrequencyGovernor::drop() {
+  esp_pm_lock_release(_lock);
+  int64_t now = esp_timer_get_time();
+  _boostedTime += now - _stateSince;
+  _stateSince = now;
+  _held = false;
+}
+
+void FrequencyGovernor::boost(bool render) {
+  if (_depth++ > 0) {
+    return;
+  }
+  _bursts++;
+  _burstStart = esp_timer_get_time();
+  if (!_enabled || _held || _ceiling) {
+    return;
+  }
+  if (render && !batteryMonitor.onUsb() && batteryMonitor.stateOfCharge() < GOVERNOR_LOW_SOC) {
+    return;
+  }
+  acquire();
+}
+
+void FrequencyGovernor::release() {
+  if (_depth == 0 || --_depth > 0) {
+    return;
+  }
+  _burstTime += esp_timer_get_time() - _burstStart;
+  _releaseTime = millis();
+}
+
+void FrequencyGovernor::update() {
+  if (_held && _depth == 0 && millis() - _releaseTime >= holdTime()) {
+    drop();
+  }
+}
+
+void FrequencyGovernor::setCeiling(bool low) {
+  _ceiling = low;
+  if (!_enabled) {  //no dynamic frequency scaling: switch the clock itself
+    if (_maxMhz == 0) {
+      _maxMhz = getCpuFrequencyMhz();
+    }
+    setCpuFrequencyMhz(low ? POWER_LOW_CPU_MHZ : _maxMhz);
+  } else if (low && _held && _depth == 0) {
+    drop();
+  }
+}
+
+void FrequencyGovernor::clear() {
+  _stateSince = esp_timer_get_time();
+  _boostedTime = _lowTime = 0;
+  _bursts = _switches = 0;
+  _switchTime = _maxSwitchTime = 0;
+  _burstTime = 0;
+}
+
+void FrequencyGovernor::print(Print &out) const {
+  if (!_enabled) {
+    out.printf("governor off, %lu MHz\n", (unsigned long)getCpuFrequencyMhz());
+    return;
+  }
+  uint64_t boosted = _boostedTime, low = _lowTime;
+  (_held ? boosted : low) += esp_timer_get_time() - _stateSince;
+  out.printf("governor %lu MHz %llu ms, %d MHz %llu ms", (unsigned long)_maxMhz, boosted / 1000, GOVERNOR_LOW_MHZ, low / 1000);
+  if (batteryMonitor.onUsb()) {
+    out.print(", on USB");
+  } else {
+    out.printf(", hold %lu ms", holdTime());
+  }
+  out.println(_ceiling ? ", ceiling" : "");
+  out.printf("bursts %lu, clock raised %lu, switch avg %lu us max %lu us, burst avg %lu us\n", (unsigned long)_bursts,
+             (unsigned long)_switches, _switches ? (unsigned long)(_switchTime / _switches) : 0UL,
+             (unsigned long)_maxSwitchTime, _bursts ? (unsigned long)(_burstTime / _bursts) : 0UL);
+}
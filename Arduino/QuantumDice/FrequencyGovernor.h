@@ -0,0 +1,67 @@
+#ifndef FREQUENCYGOVERNOR_H_
+#define FREQUENCYGOVERNOR_H_
+
+// CPU frequency governor on the ESP-IDF power management locks. Dynamic frequency scaling runs the CPU
+// at GOVERNOR_LOW_MHZ; render bursts and the measurement while THROWING hold a CPU_FREQ_MAX lock for
+// the full clock. After a burst the lock is kept for a hold time that scales with the state of charge,
+// on USB it is never released. Below GOVERNOR_LOW_SOC only the measurement gets the full clock.
+// The SPI and I2C clocks come from the 80 MHz APB clock, which GOVERNOR_LOW_MHZ keeps unchanged.
+// Trace points use the esp_timer clock and stay valid; bench holds the full clock for its cycle counts.
+#include <Arduino.h>
+#include <esp_pm.h>
+
+#define GOVERNOR_LOW_MHZ 80        //lowest frequency with an 80 MHz APB clock, needed by Wi-Fi, SPI and I2C
+#define GOVERNOR_HOLD_TIME 300     //ms full clock after a burst at 100% state of charge
+#define GOVERNOR_LOW_SOC 20        //% state of charge below which renders run at the low frequency
+
+class FrequencyGovernor {
+public:
+  void begin();                    //after the boot, which runs at the full clock
+  void boost(bool render);         //full clock until the matching release, nests
+  void release();
+  void update();                   //once per loop, drops to the low frequency after the hold time
+  void setCeiling(bool low);       //power manager LOW_CPU tier: no boosts
+  bool isBoosted() const {
+    return _held || !_enabled;
+  }
+  void print(Print &out) const;
+  void clear();
+
+private:
+  void acquire();
+  void drop();
+  unsigned long holdTime() const;
+
+  esp_pm_lock_handle_t _lock = nullptr;
+  bool _enabled = false;    //dynamic frequency scaling configured
+  bool _held = false;
+  bool _ceiling = false;
+  uint8_t _depth = 0;
+  uint32_t _maxMhz = 0;
+  unsigned long _releaseTime = 0;  //ms, last release of a burst
+
+  int64_t _stateSince = 0;   //us, last lock change
+  int64_t _burstStart = 0;
+  uint64_t _boostedTime = 0;  //us
+  uint64_t _lowTime = 0;      //us
+  uint32_t _bursts = 0;
+  uint32_t _switches = 0;     //bursts that had to raise the clock
+  uint32_t _switchTime = 0;   //us, total time in lock acquire
+  uint32_t _maxSwitchTime = 0;
+  uint64_t _burstTime = 0;    //us
+};
+
+extern FrequencyGovernor governor;
+
+// Full clock for the enclosing scope
+class FrequencyBoost {
+public:
+  explicit FrequencyBoost(bool render) {
+    governor.boost(render);
+  }
+  ~FrequencyBoost() {
+    governor.release();
+  }
+};
+
+#endif /* FREQUENCYGOVERNOR_H_ */
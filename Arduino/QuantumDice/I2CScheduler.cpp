@@ -0,0 +1,218 @@
+#define LOG_MODULE LOG_I2C
+#include "defines.h"
+#include "I2CScheduler.h"
+#include "esp_timer.h"
+#include "handyHelpers.h"
+
+I2CScheduler i2cScheduler;
+
+static const char *deviceName(uint8_t device) {
+  switch ((I2cDevice)device) {
+    case I2cDevice::IMU: return "imu";
+    case I2cDevice::ATECC: return "atecc";
+    default: return "?";
+  }
+}
+
+void I2CScheduler::begin() {
+  _since = esp_timer_get_time();
+  if (!randomChipPresent) {
+    return;
+  }
+  _ateccLock = xSemaphoreCreateMutex();
+  _queue = xQueueCreate(I2C_QUEUE_LENGTH, sizeof(I2cRequest));
+  if (!_ateccLock || !_queue || xTaskCreatePinnedToCore(workerTask, "i2cWorker", I2C_WORKER_STACK, this, I2C_WORKER_PRIORITY, &_worker, I2C_WORKER_CORE) != pdPASS) {
+    debugln("I2C worker not started, random numbers read directly");
+    _queue = nullptr;
+    return;
+  }
+  _refillQueued = request(I2cJob::RANDOM_BLOCK);
+}
+
+bool I2CScheduler::request(I2cJob job) {
+  I2cRequest queued = { job, esp_timer_get_time() };
+  return _queue && xQueueSend(_queue, &queued, 0) == pdTRUE;
+}
+
+void I2CScheduler::workerTask(void *parameter) {
+  I2CScheduler *scheduler = (I2CScheduler *)parameter;
+  I2cRequest request;
+  for (;;) {
+    if (xQueueReceive(scheduler->_queue, &request, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+    ulTaskNotifyTake(pdTRUE, 0);  //an old read does not count
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(I2C_IMU_WAIT));  //start right after an IMU read: a full interval until the next
+    scheduler->run(request);
+  }
+}
+
+void I2CScheduler::run(const I2cRequest &queued) {
+  switch (queued.job) {
+    case I2cJob::RANDOM_BLOCK: {
+      if (!lockAtecc(pdMS_TO_TICKS(I2C_IMU_WAIT))) {  //direct access in progress, the next takeRandom() asks again
+        _refillQueued = false;
+        break;
+      }
+      int64_t start = beginTransaction(I2cDevice::ATECC);
+      bool fetched = atecc.updateRandom32Bytes();
+      endTransaction(I2cDevice::ATECC, start, queued.queuedUs);
+      if (fetched) {
+        for (uint8_t value : atecc.random32Bytes) {
+          _pool.push(value);
+        }
+      }
+      unlockAtecc();
+      _refillQueued = false;
+      if (_stress || (fetched && _pool.size() < RANDOM_POOL_SIZE / 2)) {
+        _refillQueued = request(I2cJob::RANDOM_BLOCK);
+      }
+      break;
+    }
+  }
+}
+
+int64_t I2CScheduler::beginTransaction(I2cDevice device) {
+  lockBus();
+  return esp_timer_get_time();
+}
+
+void I2CScheduler::endTransaction(I2cDevice device, int64_t start, int64_t queuedUs) {
+  uint32_t busy = esp_timer_get_time() - start;
+  unlockBus();
+  I2cDeviceStats &stats = _stats[(uint8_t)device];
+  portENTER_CRITICAL(&_statsLock);
+  stats.transactions++;
+  stats.busyTime += busy;
+  stats.maxBusyTime = max(stats.maxBusyTime, busy);
+  if (queuedUs) {
+    uint32_t wait = start - queuedUs;
+    stats.waitTime += wait;
+    stats.maxWaitTime = max(stats.maxWaitTime, wait);
+  }
+  portEXIT_CRITICAL(&_statsLock);
+}
+
+void I2CScheduler::imuReadDone() {
+  int64_t now = esp_timer_get_time();
+  portENTER_CRITICAL(&_statsLock);
+  if (_lastImuRead) {
+    _maxImuInterval = max(_maxImuInterval, (uint32_t)(now - _lastImuRead));
+  }
+  _lastImuRead = now;
+  portEXIT_CRITICAL(&_statsLock);
+  if (_worker) {
+    xTaskNotifyGive(_worker);
+  }
+}
+
+// The first bus access is the ATECC or BNO055 start in the boot, before any task runs, so the lazy creation
+// does not race
+void I2CScheduler::lockBus() {
+  if (!_busLock) {
+    _busLock = xSemaphoreCreateRecursiveMutex();
+  }
+  if (_busLock) {
+    xSemaphoreTakeRecursive(_busLock, portMAX_DELAY);
+  }
+}
+
+void I2CScheduler::unlockBus() {
+  if (_busLock) {
+    xSemaphoreGiveRecursive(_busLock);
+  }
+}
+
+bool I2CScheduler::takeRandom(uint8_t *out, size_t length) {
+  if (_pool.size() < length) {
+    portENTER_CRITICAL(&_statsLock);
+    _poolMisses++;
+    portEXIT_CRITICAL(&_statsLock);
+    if (!_refillQueued) {
+      _refillQueued = request(I2cJob::RANDOM_BLOCK);
+    }
+    return false;
+  }
+  for (size_t i = 0; i < length; i++) {
+    _pool.pop(&out[i]);
+  }
+  if (_pool.size() < RANDOM_POOL_SIZE / 2 && !_refillQueued) {
+    _refillQueued = request(I2cJob::RANDOM_BLOCK);
+  }
+  return true;
+}
+
+bool I2CScheduler::lockAtecc(TickType_t wait) {
+  return !_ateccLock || xSemaphoreTake(_ateccLock, wait) == pdTRUE;
+}
+
+void I2CScheduler::unlockAtecc() {
+  if (_ateccLock) {
+    xSemaphoreGive(_ateccLock);
+  }
+}
+
+void I2CScheduler::clear() {
+  portENTER_CRITICAL(&_statsLock);
+  memset(_stats, 0, sizeof(_stats));
+  _maxImuInterval = 0;
+  _lastImuRead = 0;
+  _poolMisses = 0;
+  _since = esp_timer_get_time();
+  portEXIT_CRITICAL(&_statsLock);
+}
+
+void I2CScheduler::print(Print &out) const {
+  I2cDeviceStats snapshot[(uint8_t)I2cDevice::COUNT];
+  portENTER_CRITICAL(&_statsLock);  //consistent copy, printing is too slow for a critical section
+  memcpy(snapshot, _stats, sizeof(snapshot));
+  uint32_t maxImuInterval = _maxImuInterval;
+  unsigned long poolMisses = _poolMisses;
+  uint64_t elapsed = esp_timer_get_time() - _since;
+  portEXIT_CRITICAL(&_statsLock);
+  for (uint8_t i = 0; i < (uint8_t)I2cDevice::COUNT; i++) {
+    const I2cDeviceStats &stats = snapshot[i];
+    unsigned long count = max(stats.transactions, 1UL);
+    out.printf("%-6s %lu transactions, bus %.1f%%, busy avg %lu us max %lu us, wait avg %lu us max %lu us\n",
+               deviceName(i), stats.transactions, elapsed ? 100.0f * stats.busyTime / elapsed : 0.0f,
+               (unsigned long)(stats.busyTime / count), (unsigned long)stats.maxBusyTime,
+               (unsigned long)(stats.waitTime / count), (unsigned long)stats.maxWaitTime);
+  }
+  out.printf("imu read interval max %lu us, random pool %u bytes, %lu misses\n", (unsigned long)maxImuInterval,
+             (unsigned)_pool.size(), poolMisses);
+}
+
+// Back to back RNG commands on the worker, the IMU read interval shows what they cost the sampler.
+// The wait runs in its own task, the loop keeps going
+void I2CScheduler::stress(Print &out) {
+  if (!_queue) {
+    out.println("no ATECC worker");
+    return;
+  }
+  if (_stressTask) {
+    out.println("stress test running");
+    return;
+  }
+  _stressOut = &out;
+  if (xTaskCreatePinnedToCore(stressTask, "i2cStress", I2C_STRESS_STACK, this, I2C_STRESS_PRIORITY, &_stressTask, I2C_STRESS_CORE) != pdPASS) {
+    _stressTask = nullptr;
+    out.println("stress task not started");
+  }
+}
+
+void I2CScheduler::stressTask(void *parameter) {
+  I2CScheduler *scheduler = (I2CScheduler *)parameter;
+  Print &out = *scheduler->_stressOut;
+  out.printf("idle: imu read interval max %lu us\n", (unsigned long)scheduler->_maxImuInterval);
+  scheduler->clear();
+  scheduler->_stress = true;
+  if (!scheduler->_refillQueued) {
+    scheduler->_refillQueued = scheduler->request(I2cJob::RANDOM_BLOCK);
+  }
+  vTaskDelay(pdMS_TO_TICKS(I2C_STRESS_TIME));
+  scheduler->_stress = false;
+  out.print("stress: ");
+  scheduler->print(out);
+  scheduler->_stressTask = nullptr;
+  vTaskDelete(nullptr);
+}
@@ -0,0 +1,94 @@
+#ifndef I2CSCHEDULER_H_
+#define I2CSCHEDULER_H_
+
+// I2C scheduler for the bus shared by the BNO055 and the ATECC. ATECC commands are queued and run by a
+// worker task on the sampler's core at a lower priority, started right after an IMU read, so a command
+// usually finishes before the next read is due. Random bytes are fetched ahead into a pool;
+// generateDiceRoll() takes from the pool instead of waiting for the ATECC. Bus utilisation and latency
+// per device are printed by the "i2c" serial command, "i2c stress" runs RNG commands back to back in its
+// own task to show the IMU jitter.
+// Every device access is a transaction under one recursive bus lock: ATECC commands, which wake the chip
+// and wait for its execution between their transfers, and BNO055 register sequences from the loop (config
+// mode, register page 1) cannot interleave with the sampler's reads.
+#include <Arduino.h>
+#include "RingBuffer.h"
+
+#define I2C_WORKER_STACK 4096
+#define I2C_WORKER_PRIORITY 2     //below IMU_SAMPLER_PRIORITY
+#define I2C_WORKER_CORE 0         //same core as the sampler, which preempts it
+#define I2C_QUEUE_LENGTH 4
+#define I2C_IMU_WAIT 20           //ms to wait for an IMU read before an ATECC command, no sampler running
+#define RANDOM_POOL_SIZE 129      //ring capacity 128 bytes: four ATECC blocks
+#define I2C_STRESS_TIME 5000      //ms of back to back RNG commands for "i2c stress"
+#define I2C_STRESS_STACK 3072
+#define I2C_STRESS_PRIORITY 1     //below the worker, only sleeps until the end of the test
+#define I2C_STRESS_CORE 0
+
+enum class I2cDevice : uint8_t {
+  IMU,
+  ATECC,
+  COUNT
+};
+
+enum class I2cJob : uint8_t {
+  RANDOM_BLOCK,  //32 bytes into the random pool
+};
+
+struct I2cRequest {
+  I2cJob job;
+  int64_t queuedUs;
+};
+
+struct I2cDeviceStats {
+  unsigned long transactions;
+  uint64_t busyTime;     //us
+  uint32_t maxBusyTime;  //us
+  uint64_t waitTime;     //us between request and start
+  uint32_t maxWaitTime;
+};
+
+class I2CScheduler {
+public:
+  void begin();  //after atecc.begin(), starts the worker and fills the random pool
+
+  int64_t beginTransaction(I2cDevice device);  //around each device access, takes the bus lock and returns the start time
+  void endTransaction(I2cDevice device, int64_t start, int64_t queuedUs = 0);
+  void imuReadDone();                          //from the sampler, releases a waiting ATECC command
+  void lockBus();                              //register sequences over several transactions, nests with them
+  void unlockBus();
+
+  bool takeRandom(uint8_t *out, size_t length);  //false when the pool is empty
+  bool lockAtecc(TickType_t wait = portMAX_DELAY);  //direct ATECC access outside the worker
+  void unlockAtecc();
+
+  void print(Print &out) const;
+  void clear();
+  void stress(Print &out);  //returns at once, the stress task prints the result
+
+private:
+  static void workerTask(void *parameter);
+  static void stressTask(void *parameter);
+  void run(const I2cRequest &queued);
+  bool request(I2cJob job);
+
+  QueueHandle_t _queue = nullptr;
+  SemaphoreHandle_t _ateccLock = nullptr;  //the ATECC library keeps the command and response in the object
+  SemaphoreHandle_t _busLock = nullptr;    //recursive, created by the first bus access during the boot
+  TaskHandle_t _worker = nullptr;
+  TaskHandle_t _stressTask = nullptr;
+  Print *_stressOut = nullptr;
+  RingBuffer<uint8_t, RANDOM_POOL_SIZE> _pool;
+  volatile bool _refillQueued = false;
+  volatile bool _stress = false;
+
+  mutable portMUX_TYPE _statsLock = portMUX_INITIALIZER_UNLOCKED;  //statistics are updated from three tasks
+  I2cDeviceStats _stats[(uint8_t)I2cDevice::COUNT] = {};
+  int64_t _lastImuRead = 0;
+  uint32_t _maxImuInterval = 0;  //us between IMU reads, the jitter the ATECC can cause
+  unsigned long _poolMisses = 0;
+  int64_t _since = 0;
+};
+
+extern I2CScheduler i2cScheduler;
+
+#endif /* I2CSCHEDULER_H_ */
@@ -1,82 +1,68 @@
+#define LOG_MODULE LOG_IMU
 #include "Adafruit_Sensor.h"
 #include "Arduino.h"
+#include "esp_timer.h"
+#include "TracePoints.h"
+#include "LoopProfiler.h"
+#include "I2CScheduler.h"
 #include "defines.h"
 #include "IMUhelpers.h"
 #include "handyHelpers.h"  // Include for EEPROM address definitions
 
 //***************************** IMU independant functions
-void IMUSensor::updateUpVector(double deltaTime) {
-  // Calculate the new Up
-  double xRot = _xGyro * deltaTime;  //rotation angle over the last deltaTime
-  double yRot = _yGyro * deltaTime;
-  double zRot = _zGyro * deltaTime;
-
-  // // Exponential moving average filter (https://en.wikipedia.org/wiki/Moving_average#Exponential_moving_average)
-  // xRot = ALPHA * xRot + (1 - ALPHA) * _xRotPrev;
-  // yRot = ALPHA * yRot + (1 - ALPHA) * _yRotPrev;
-  // zRot = ALPHA * zRot + (1 - ALPHA) * _zRotPrev;
-  //
-  // _xRotPrev = xRot;
-  // _yRotPrev = yRot;
-  // _zRotPrev = zRot;
-
-  // debug("Rotation ");
-  // debug(deltaTime);
-  // debug(", ");
-  // debug(xRot);
-  // debug(", ");
-  // debug(yRot);
-  // debug(", ");
-  // debugln(zRot);
-
-  // x-axis rotation matrix
-  double xUp = _xUp;
-  double yUp = _yUp * cos(xRot) - _zUp * sin(xRot);
-  double zUp = _yUp * sin(xRot) + _zUp * cos(xRot);
-
-  _xUp = xUp;
-  _yUp = yUp;
-  _zUp = zUp;
-
-  // y-axis
-  xUp = _xUp * cos(yRot) + _zUp * sin(yRot);
-  yUp = _yUp;
-  zUp = -_xUp * sin(yRot) + _zUp * cos(yRot);
-
-  _xUp = xUp;
-  _yUp = yUp;
-  _zUp = zUp;
-
-  // z-axis
-  xUp = _xUp * cos(zRot) - _yUp * sin(zRot);
-  yUp = _xUp * sin(zRot) + _yUp * cos(zRot);
-  zUp = _zUp;
-
-  _xUp = xUp;
-  _yUp = yUp;
-  _zUp = zUp;
-
-  // debug("Up (");
-  // debug(_xUp);
-  // debug(", ");
-  // debug(_yUp);
-  // debug(", ");
-  // debug(_zUp);
-  // debugln(")");
+void HOT_PATH IMUSensor::updateUpVector(float deltaTime) {
+  // Rotation over the last deltaTime as quaternion dq = (cos(angle/2), sin(angle/2) * axis)
+  float angularSpeed = sqrtf(_xGyro * _xGyro + _yGyro * _yGyro + _zGyro * _zGyro);
+  float halfAngle = 0.5f * angularSpeed * deltaTime;
+  float dw, scale;
+  if (halfAngle < 1e-4f) {  //small angle: sin(a)/a ~ 1, avoids division by ~0
+    dw = 1.0f;
+    scale = 0.5f * deltaTime;
+  } else {
+    dw = cosf(halfAngle);
+    scale = sinf(halfAngle) / angularSpeed;
+  }
+  float dx = _xGyro * scale;
+  float dy = _yGyro * scale;
+  float dz = _zGyro * scale;
+
+  // q = dq * q, new rotations are applied on top of the accumulated one
+  float qw = dw * _qw - dx * _qx - dy * _qy - dz * _qz;
+  float qx = dw * _qx + dx * _qw + dy * _qz - dz * _qy;
+  float qy = dw * _qy + dy * _qw + dz * _qx - dx * _qz;
+  float qz = dw * _qz + dz * _qw + dx * _qy - dy * _qx;
+
+  // Renormalise to stop rounding errors from accumulating
+  float inverseNorm = 1.0f / sqrtf(qw * qw + qx * qx + qy * qy + qz * qz);
+  _qw = qw * inverseNorm;
+  _qx = qx * inverseNorm;
+  _qy = qy * inverseNorm;
+  _qz = qz * inverseNorm;
+}
+
+void IMUSensor::getUpVector(float &xUp, float &yUp, float &zUp) const {
+  // Rotate the start up vector by q: v' = v + w * t + q x t, with t = 2 * (q x v)
+  float tx = 2.0f * (_qy * _zUpStart - _qz * _yUpStart);
+  float ty = 2.0f * (_qz * _xUpStart - _qx * _zUpStart);
+  float tz = 2.0f * (_qx * _yUpStart - _qy * _xUpStart);
+  xUp = _xUpStart + _qw * tx + (_qy * tz - _qz * ty);
+  yUp = _yUpStart + _qw * ty + (_qz * tx - _qx * tz);
+  zUp = _zUpStart + _qw * tz + (_qx * ty - _qy * tx);
 }
 
 void IMUSensor::reset() {
-  _prevMicros = micros();
+  _prevSampleTime = clockUs();  //samples taken before the reset add no rotation
 
-  float inverseMagnitude = 1.0 / sqrt((_xGravity * _xGravity + _yGravity * _yGravity + _zGravity * _zGravity));
+  float inverseMagnitude = 1.0f / sqrtf((_xGravity * _xGravity + _yGravity * _yGravity + _zGravity * _zGravity));
 
   _xUpStart = -_xGravity * inverseMagnitude;  //unit vector
   _yUpStart = -_yGravity * inverseMagnitude;
   _zUpStart = -_zGravity * inverseMagnitude;
 
-  _xUp = _xUpStart;
-  _yUp = _yUpStart;
-  _zUp = _zUpStart;
+  _qw = 1.0f;  //no rotation yet
+  _qx = 0.0f;
+  _qy = 0.0f;
+  _qz = 0.0f;
 
   debug("Reset (");
   debug(_xUpStart);
@@ -89,50 +75,23 @@ void IMUSensor::reset() {
 }
 
 bool IMUSensor::tumbled(float minRotation) {
-  // debug("Start Up (");
-  // debug(_xUpStart, 2);
-  // debug(", ");
-  // debug(_yUpStart, 2);
-  // debug(", ");
-  // debug(_zUpStart, 2);
-  // debug(", ");
-  // //debugln(")");
-
-  // //debug("Up (");
-  // debug(_xUp, 2);
-  // debug(", ");
-  // debug(_yUp, 2);
-  // debug(", ");
-  // debug(_zUp, 2);
-  // debug(", ");
-  //debugln(")");
-  double dotProduct = _xUp * _xUpStart + _yUp * _yUpStart + _zUp * _zUpStart;
-
-  // Clamp dot product to valid range for acos [-1, 1]
-  dotProduct = constrain(dotProduct, -1.0, 1.0);
-  double rotation = acos(dotProduct) / TWOPI;  //inverse cos of dot product between vectors, normalised (2PI=1.0). Max rotation: 0.5
-
-  if (abs(rotation) > (double)minRotation) {
-    debug("Start Up (");
-    debug(_xUpStart);
-    debug(", ");
-    debug(_yUpStart);
-    debug(", ");
-    debug(_zUpStart);
-    debug(", ");
-    debugln(")");
+  // rotation = acos(dot) / TWOPI is at most 0.5, so larger limits can never be reached
+  if (minRotation >= 0.5f) {
+    return false;
+  }
+  // acos is decreasing: rotation > minRotation  <=>  dot < cos(TWOPI * minRotation). Only recalculated when the limit changes
+  if (minRotation != _tumbleMinRotation) {
+    _tumbleMinRotation = minRotation;
+    _tumbleCosLimit = cosf(TWOPI * fabsf(minRotation));
+  }
 
-    debug("Up (");
-    debug(_xUp);
-    debug(", ");
-    debug(_yUp);
-    debug(", ");
-    debug(_zUp);
-    debug(", ");
-    debugln(")");
-    debug("Rotation: ");
-    debug(rotation);
-    debugln();
+  float xUp, yUp, zUp;
+  getUpVector(xUp, yUp, zUp);
+  float dotProduct = xUp * _xUpStart + yUp * _yUpStart + zUp * _zUpStart;
+
+  if (dotProduct < _tumbleCosLimit) {
+    debugRecord(TUMBLE, _xUpStart, _yUpStart, _zUpStart, xUp, yUp, zUp,
+                acosf(constrain(dotProduct, -1.0f, 1.0f)) / TWOPI);  //rotation only calculated for the debug output
     reset();
     return true;
   }
@@ -140,22 +99,303 @@ bool IMUSensor::tumbled(float minRotation) {
 }
 
 bool IMUSensor::isMoving() {
+  // Moving, or stopped moving less than stableTime ago. The state itself is updated per sample in processSample()
+  if (!_isMoving && (clockMs() - _lastMovementTime > stableTime)) {
+    return false;
+  } else {
+    return true;
+  }
+}
+
+void IMUSensor::processSample(const ImuSample &sample) {
+  if (_offline) {
+    _offlineTimeUs = sample.timeUs;
+  } else {
+    _recorder.record(sample);
+    loopProfiler.addImuSample(sample.timeUs, esp_timer_get_time());
+  }
+
+  bool rest = sample.flags & SAMPLE_REST;
+  _xGyro = rest ? 0.0f : sample.xGyro - _xGyroBias;
+  _yGyro = rest ? 0.0f : sample.yGyro - _yGyroBias;
+  _zGyro = rest ? 0.0f : sample.zGyro - _zGyroBias;
+  _ax = sample.ax;
+  _ay = sample.ay;
+  _az = sample.az;
+  _magnitude = sqrtf(_ax * _ax + _ay * _ay + _az * _az);
+  _xGravity = sample.xGravity;
+  _yGravity = sample.yGravity;
+  _zGravity = sample.zGravity;
+
+  if (sample.flags & SAMPLE_ANY_MOTION) {
+    _motionState = MotionState::MOVING;
+  } else if (sample.flags & SAMPLE_NO_MOTION) {
+    _motionState = MotionState::STILL;
+    _motionStop = true;
+  }
+  if (sample.flags & SAMPLE_POLLING) {
+    _motionState = MotionState::UNKNOWN;
+  }
+
+  // Integrate with the time between the reads, not the time between loop iterations
+  int64_t elapsed = sample.timeUs - _prevSampleTime;
+  if (elapsed > 0) {
+    updateUpVector(elapsed * 1e-6f);
+    _prevSampleTime = sample.timeUs;
+  }
+
   // Check if magnitude is below the threshold. If it was moving, set it to false and keep the timestamp of that moment
   if (_magnitude < threshold) {
     if (_isMoving) {
-      _lastMovementTime = millis();
+      _lastMovementTime = (unsigned long)(sample.timeUs / 1000);  //same clock as millis()
       _isMoving = false;
     }
   } else {
     _isMoving = true;
   }
-  if (!_isMoving && (millis() - _lastMovementTime > stableTime)) {
+
+  // Sliding window for the rest detector
+  _restGravity[_restIndex][0] = _xGravity;
+  _restGravity[_restIndex][1] = _yGravity;
+  _restGravity[_restIndex][2] = _zGravity;
+  _restGyro[_restIndex] = sqrtf(_xGyro * _xGyro + _yGyro * _yGyro + _zGyro * _zGyro);
+  _restMagnitude[_restIndex] = _magnitude;
+  _restIndex = (_restIndex + 1) % REST_WINDOW;
+  if (_restCount < REST_WINDOW) {
+    _restCount++;
+  }
+
+  if (isSettled() && !rest) {
+    correctDrift(sample.xGyro, sample.yGyro, sample.zGyro);
+  }
+}
+
+// Only called while settled: whatever the gyro reads is bias, and measured gravity is the true up vector
+void IMUSensor::correctDrift(float rawXGyro, float rawYGyro, float rawZGyro) {
+  _xGyroBias = constrain(_xGyroBias + GYRO_BIAS_ALPHA * (rawXGyro - _xGyroBias), -GYRO_BIAS_LIMIT, GYRO_BIAS_LIMIT);
+  _yGyroBias = constrain(_yGyroBias + GYRO_BIAS_ALPHA * (rawYGyro - _yGyroBias), -GYRO_BIAS_LIMIT, GYRO_BIAS_LIMIT);
+  _zGyroBias = constrain(_zGyroBias + GYRO_BIAS_ALPHA * (rawZGyro - _zGyroBias), -GYRO_BIAS_LIMIT, GYRO_BIAS_LIMIT);
+
+  // Complementary correction: rotate the integrated up vector a fraction of the way toward measured gravity.
+  // The rotation axis is up x measured; for small errors its length is the angle between them
+  float gravityMagnitude = sqrtf(_xGravity * _xGravity + _yGravity * _yGravity + _zGravity * _zGravity);
+  if (gravityMagnitude < LOWERBOUND) {
+    return;
+  }
+  float xMeasured = -_xGravity / gravityMagnitude;
+  float yMeasured = -_yGravity / gravityMagnitude;
+  float zMeasured = -_zGravity / gravityMagnitude;
+  float xUp, yUp, zUp;
+  getUpVector(xUp, yUp, zUp);
+  float halfPull = 0.5f * GRAVITY_PULL;
+  float dx = halfPull * (yUp * zMeasured - zUp * yMeasured);
+  float dy = halfPull * (zUp * xMeasured - xUp * zMeasured);
+  float dz = halfPull * (xUp * yMeasured - yUp * xMeasured);
+
+  // q = dq * q with dq = (1, d), then renormalise
+  float qw = _qw - dx * _qx - dy * _qy - dz * _qz;
+  float qx = _qx + dx * _qw + dy * _qz - dz * _qy;
+  float qy = _qy + dy * _qw + dz * _qx - dx * _qz;
+  float qz = _qz + dz * _qw + dx * _qy - dy * _qx;
+  float inverseNorm = 1.0f / sqrtf(qw * qw + qx * qx + qy * qy + qz * qz);
+  _qw = qw * inverseNorm;
+  _qx = qx * inverseNorm;
+  _qy = qy * inverseNorm;
+  _qz = qz * inverseNorm;
+}
+
+// Sensor axis (0, 1, 2) carrying gravity within LOWERBOUND..UPPERBOUND, -1 when none
+static int8_t gravityAxis(const float gravity[3]) {
+  for (int8_t axis = 0; axis < 3; axis++) {
+    if (withinBounds(fabsf(gravity[axis]), LOWERBOUND, UPPERBOUND)) {
+      return axis;
+    }
+  }
+  return -1;
+}
+
+bool IMUSensor::isSettled() const {
+  if (_restCount < REST_WINDOW) {
     return false;
-  } else {
-    return true;
+  }
+
+  // Quiet: no rotation, no linear acceleration
+  for (uint8_t i = 0; i < REST_WINDOW; i++) {
+    if (_restGyro[i] > REST_GYRO_LIMIT || _restMagnitude[i] >= threshold) {
+      return false;
+    }
+  }
+
+  // Stable gravity vector
+  float mean[3], variance = 0.0f;
+  getRestGravity(mean[0], mean[1], mean[2]);
+  for (uint8_t i = 0; i < REST_WINDOW; i++) {
+    for (uint8_t axis = 0; axis < 3; axis++) {
+      float deviation = _restGravity[i][axis] - mean[axis];
+      variance += deviation * deviation;
+    }
+  }
+  if (variance / REST_WINDOW > REST_GRAVITY_VARIANCE) {
+    return false;
+  }
+
+  // Axis vote: every sample in the window must point to the same axis
+  int8_t axis = gravityAxis(_restGravity[0]);
+  if (axis < 0) {
+    return false;
+  }
+  for (uint8_t i = 1; i < REST_WINDOW; i++) {
+    if (gravityAxis(_restGravity[i]) != axis) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void IMUSensor::getRestGravity(float &xGravity, float &yGravity, float &zGravity) const {
+  if (_restCount < REST_WINDOW) {  //window not filled yet: latest sample
+    xGravity = _xGravity;
+    yGravity = _yGravity;
+    zGravity = _zGravity;
+    return;
+  }
+  xGravity = yGravity = zGravity = 0.0f;
+  for (uint8_t i = 0; i < REST_WINDOW; i++) {
+    xGravity += _restGravity[i][0];
+    yGravity += _restGravity[i][1];
+    zGravity += _restGravity[i][2];
+  }
+  xGravity /= REST_WINDOW;
+  yGravity /= REST_WINDOW;
+  zGravity /= REST_WINDOW;
+}
+
+void IMUSensor::update() {
+  ImuSample sample;
+  if (_samplerTask) {
+    while (_samples.pop(&sample)) {
+      processSample(sample);
+      _processedSamples++;
+    }
+  } else if (readSample(sample)) {
+    processSample(sample);
+    _processedSamples++;
+  }
+  reportStats();
+}
+
+void IMUSensor::startSampler(uint32_t intervalMs) {
+  if (_samplerTask) {
+    return;
+  }
+  _sampleInterval = intervalMs;
+  _windowStats.minInterval = UINT32_MAX;
+  if (xTaskCreatePinnedToCore(samplerTask, "imuSampler", IMU_SAMPLER_STACK, this, IMU_SAMPLER_PRIORITY, &_samplerTask, IMU_SAMPLER_CORE) != pdPASS) {
+    _samplerTask = nullptr;
+    debugln("IMU sampler task not started, polling in the loop");
+    return;
+  }
+  debug("IMU sampler started, interval ms: ");
+  debugln(intervalMs);
+}
+
+void IMUSensor::samplerTask(void *parameter) {
+  IMUSensor *sensor = (IMUSensor *)parameter;
+  TickType_t lastWake = xTaskGetTickCount();
+  for (;;) {
+    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(sensor->_sampleInterval));
+    if (sensor->_stopSampler) {  //between reads, so no I2C transaction is left half done
+      sensor->_samplerTask = nullptr;
+      vTaskDelete(nullptr);
+    }
+    sensor->takeSample();
   }
 }
 
+void IMUSensor::stopSampler() {
+  if (!_samplerTask) {
+    return;
+  }
+  _stopSampler = true;
+  while (_samplerTask) {
+    delay(1);
+  }
+  _stopSampler = false;
+}
+
+// Sampler task: read, timestamp, queue and keep the interval statistics
+void IMUSensor::takeSample() {
+  ImuSample sample;
+  int64_t start = esp_timer_get_time();
+  TRACE_BEGIN(IMU_READ, 0);
+  bool sampled = readSample(sample);
+  TRACE_END(IMU_READ, 0);
+  if (!sampled) {
+    return;
+  }
+  _samples.push(sample);
+
+  if (_lastSampleTime != 0) {
+    uint32_t interval = sample.timeUs - _lastSampleTime;
+    _windowStats.samples++;
+    _windowIntervalTotal += interval;
+    uint32_t readTime = esp_timer_get_time() - start;
+    _windowReadTimeTotal += readTime;
+    if (readTime > _windowStats.maxReadTime) _windowStats.maxReadTime = readTime;
+    if (interval < _windowStats.minInterval) _windowStats.minInterval = interval;
+    if (interval > _windowStats.maxInterval) _windowStats.maxInterval = interval;
+    if (interval > _sampleInterval * 1500UL) _windowStats.late++;
+
+    if (_windowStats.samples >= IMU_STATS_WINDOW) {
+      _windowStats.meanInterval = _windowIntervalTotal / _windowStats.samples;
+      _windowStats.meanReadTime = _windowReadTimeTotal / _windowStats.samples;
+      _samplerStats = _windowStats;  //publish for the loop
+      _windowStats = {};
+      _windowStats.minInterval = UINT32_MAX;
+      _windowIntervalTotal = 0;
+      _windowReadTimeTotal = 0;
+    }
+  }
+  _lastSampleTime = sample.timeUs;
+}
+
+void IMUSensor::reportStats() {
+  unsigned long now = millis();
+  if (now - _lastReport < SAMPLE_RATE_REPORT_INTERVAL) {
+    return;
+  }
+  unsigned long elapsed = now - _lastReport;
+  if (_lastReport != 0) {
+    debug("IMU samples/s: ");
+    debug((_processedSamples - _reportedSamples) * 1000.0 / elapsed);
+    debug(" dropped: ");
+    debug(getDroppedSamples() - _reportedDropped);
+    if (_samplerTask && _samplerStats.samples > 0) {
+      debug(" interval us min/mean/max: ");
+      debug(_samplerStats.minInterval);
+      debug("/");
+      debug(_samplerStats.meanInterval);
+      debug("/");
+      debug(_samplerStats.maxInterval);
+      debug(" late: ");
+      debug(_samplerStats.late);
+      debug(" read us: ");
+      debug(_samplerStats.meanReadTime);
+    }
+    debug(" gyro bias mrad/s: ");
+    debug(_xGyroBias * 1000);
+    debug(", ");
+    debug(_yGyroBias * 1000);
+    debug(", ");
+    debug(_zGyroBias * 1000);
+    printSensorStats(elapsed);
+    debugln();
+  }
+  _lastReport = now;
+  _reportedSamples = _processedSamples;
+  _reportedDropped = getDroppedSamples();
+}
+
 Adafruit_BNO055 AccGyro = Adafruit_BNO055(55, 0x28, &Wire);
 sensors_event_t angVelocityData, linearAccelData, gravityData;
 
@@ -169,53 +409,76 @@ void BNO055IMUSensor::init() {
     delay(100);
   }
   debugln("BNO device found!");
+  Wire.setClock(BNO055_I2C_CLOCK);  //after begin(), which may set the default clock
 
   // Try to restore calibration data from EEPROM
   restoreCalibrationData();
 
   // Set external crystal use (must be done after loading calibration)
   _accGyro.setExtCrystalUse(true);
+  _driverStarted = true;
+
+  waitForGravity();
+  enableMotionInterrupts(IMU_INT_PIN);
 
-  // Wait for valid gravity data before calling reset
+  debugln("IMU initialization complete");
+}
+
+// Warm resume: the BNO055 stayed powered and kept its calibration, so no reset and no restore.
+// Back to normal power and NDOF first, fusion has no gravity in accelerometer only mode
+void BNO055IMUSensor::resume() {
+  Wire.begin();
+  Wire.setClock(BNO055_I2C_CLOCK);
+  enableMotionInterrupts(IMU_INT_PIN);
+  debug("IMU resumed, calibration status: ");
+  debugln(getCalibrationStatus());
+  waitForGravity();
+}
+
+// Only the accelerometer runs while the ESP32 sleeps, any-motion on the INT pin wakes both
+void BNO055IMUSensor::prepareSleep() {
+  i2cScheduler.lockBus();
+  configureMotionEngine(true);
+  readRegister(BNO055_REG_INT_STA);  //clear
+  writeRegister(BNO055_REG_SYS_TRIGGER, BNO055_SYS_TRIGGER_CLK_SEL | BNO055_SYS_TRIGGER_RST_INT);
+  i2cScheduler.unlockBus();
+}
+
+uint8_t BNO055IMUSensor::getCalibrationStatus() {
+  return readRegister(BNO055_REG_CALIB_STAT);
+}
+
+void BNO055IMUSensor::waitForGravity() {
+  // Wait for valid gravity data before calling reset, polled at the sample rate
   debugln("Waiting for valid gravity data...");
-  int attempts = 0;
+  unsigned long start = millis();
   float gravityMagnitude = 0.0;
 
   do {
-    delay(100);
+    delay(IMU_SAMPLE_INTERVAL);
     update();  // Get sensor reading
-    attempts++;
-
     gravityMagnitude = sqrt(_xGravity * _xGravity + _yGravity * _yGravity + _zGravity * _zGravity);
+  } while (gravityMagnitude < 8.0 && millis() - start < IMU_GRAVITY_TIMEOUT);
 
-    debug("Attempt ");
-    debug(attempts);
-    debug(" - Gravity: (");
-    debug(_xGravity);
-    debug(", ");
-    debug(_yGravity);
-    debug(", ");
-    debug(_zGravity);
-    debug(") Magnitude: ");
-    debugln(gravityMagnitude);
-
-  } while (gravityMagnitude < 8.0 && attempts < 100);
+  debug("Gravity after ms: ");
+  debug(millis() - start);
+  debug(" magnitude: ");
+  debugln(gravityMagnitude);
 
   if (gravityMagnitude >= 8.0) {
     reset();
     debugln("Up vector initialized successfully");
   } else {
-    debugln("Warning: Failed to get valid gravity data after 100 attempts!");
+    debugln("Warning: Failed to get valid gravity data!");
     // Set a default up vector as fallback
-    _xUp = 0.0;
-    _yUp = 0.0;
-    _zUp = 1.0;
+    _qw = 1.0f;
+    _qx = 0.0f;
+    _qy = 0.0f;
+    _qz = 0.0f;
     _xUpStart = 0.0;
     _yUpStart = 0.0;
     _zUpStart = 1.0;
   }
-
-  debugln("IMU initialization complete");
 }
 
 void BNO055IMUSensor::restoreCalibrationData() {
@@ -275,7 +538,6 @@ void BNO055IMUSensor::restoreCalibrationData() {
   }
 
   // Optional: Display current calibration status
-  delay(100);  // Give sensor time to settle
   displayCalStatus();
 }
 
@@ -316,7 +578,9 @@ void BNO055IMUSensor::displayCalStatus(void) {
   /* 3 means 'fully calibrated" */
   uint8_t system, gyro, accel, mag;
   system = gyro = accel = mag = 0;
+  int64_t start = i2cScheduler.beginTransaction(I2cDevice::IMU);
   AccGyro.getCalibration(&system, &gyro, &accel, &mag);
+  i2cScheduler.endTransaction(I2cDevice::IMU, start);
 
   /* Display the individual values */
   Serial.print("Calibration Status - Sys:");
@@ -334,62 +598,211 @@ void BNO055IMUSensor::displayCalStatus(void) {
   debugln();
 }
 
-void BNO055IMUSensor::update() {
-  unsigned long currentMicros = micros();
-  double deltaTime = (currentMicros - _prevMicros) * 1e-6;
+bool BNO055IMUSensor::readSample(ImuSample &sample) {
+  uint8_t flags = 0;
+  if (_useInterrupts) {
+    if (_interruptPending) {
+      flags = handleMotionInterrupt();
+    }
+    // At rest nothing changes: no read, apart from a slow check that the interrupt line still works
+    if (!_motionActive && (millis() - _lastCheckRead < MOTION_CHECK_INTERVAL)) {
+      _skippedReads++;
+      sample = _restSample;
+      sample.timeUs = esp_timer_get_time();
+      sample.flags = flags | SAMPLE_REST;  //the gyro bias belongs to the loop, processSample() zeroes the rotation
+      return true;
+    }
+  }
+
+  sample.timeUs = esp_timer_get_time();
+  sample.flags = flags;
+  if (!burstRead(sample)) {
+    _burstFailCount++;
+    if (!_driverStarted || !eventRead(sample)) {  //fallback: three separate reads through the Adafruit driver
+      return false;
+    }
+  }
+
+  // rest sample: last gravity, no rotation and no acceleration
+  _restSample = sample;
+  _restSample.xGyro = _restSample.yGyro = _restSample.zGyro = 0.0f;
+  _restSample.ax = _restSample.ay = _restSample.az = 0.0f;
+
+  if (_useInterrupts && !_motionActive) {
+    _lastCheckRead = millis();
+    if (sqrtf(sample.ax * sample.ax + sample.ay * sample.ay + sample.az * sample.az) >= threshold) {  //moving without any-motion interrupt: line or engine not working
+      debugln("IMU motion without interrupt, fallback to polling");
+      _useInterrupts = false;
+      detachInterrupt(digitalPinToInterrupt(_intPin));
+      sample.flags |= SAMPLE_POLLING;
+    }
+  }
+  return true;
+}
+
+// Read gyro, linear acceleration and gravity in one I2C transaction and decode in place
+bool BNO055IMUSensor::burstRead(ImuSample &sample) {
+  uint8_t buffer[BNO055_BURST_LENGTH];
+
+  int64_t start = i2cScheduler.beginTransaction(I2cDevice::IMU);
+  Wire.beginTransmission(BNO055_I2C_ADDRESS);
+  Wire.write((uint8_t)BNO055_BURST_START_ADDR);
+  bool received = Wire.endTransmission(false) == 0
+                  && Wire.requestFrom((uint8_t)BNO055_I2C_ADDRESS, (uint8_t)BNO055_BURST_LENGTH) == BNO055_BURST_LENGTH;
+  i2cScheduler.endTransaction(I2cDevice::IMU, start);
+  i2cScheduler.imuReadDone();  //queued ATECC commands start now, a full interval before the next read
+  if (!received) {
+    return false;
+  }
+  for (uint8_t i = 0; i < BNO055_BURST_LENGTH; i++) {
+    buffer[i] = Wire.read();
+  }
+
+  // little endian int16 at an offset relative to BNO055_BURST_START_ADDR
+  auto raw = [&buffer](uint8_t reg) -> int16_t {
+    uint8_t offset = reg - BNO055_BURST_START_ADDR;
+    return (int16_t)(buffer[offset] | (buffer[offset + 1] << 8));
+  };
+
+  const float gyroScale = SENSORS_DPS_TO_RADS / BNO055_GYRO_LSB_PER_DPS;  //rad/s, like getEvent(VECTOR_GYROSCOPE)
+  sample.xGyro = raw(0x14) * gyroScale;
+  sample.yGyro = raw(0x16) * gyroScale;
+  sample.zGyro = raw(0x18) * gyroScale;
+
+  sample.ax = raw(0x28) / BNO055_ACC_LSB_PER_MS2;
+  sample.ay = raw(0x2A) / BNO055_ACC_LSB_PER_MS2;
+  sample.az = raw(0x2C) / BNO055_ACC_LSB_PER_MS2;
+
+  sample.xGravity = raw(0x2E) / BNO055_ACC_LSB_PER_MS2;
+  sample.yGravity = raw(0x30) / BNO055_ACC_LSB_PER_MS2;
+  sample.zGravity = raw(0x32) / BNO055_ACC_LSB_PER_MS2;
+  return true;
+}
+
+bool BNO055IMUSensor::eventRead(ImuSample &sample) {
   sensors_event_t angVelocityData, linearAccelData, gravityData;
-  _accGyro.getEvent(&angVelocityData, Adafruit_BNO055::VECTOR_GYROSCOPE);
-  _accGyro.getEvent(&linearAccelData, Adafruit_BNO055::VECTOR_LINEARACCEL);
-  _accGyro.getEvent(&gravityData, Adafruit_BNO055::VECTOR_GRAVITY);
-  processData(&angVelocityData);
-  processData(&linearAccelData);
-  processData(&gravityData);
-  updateUpVector(deltaTime);
-  _prevMicros = currentMicros;
+  int64_t start = i2cScheduler.beginTransaction(I2cDevice::IMU);
+  bool received = _accGyro.getEvent(&angVelocityData, Adafruit_BNO055::VECTOR_GYROSCOPE) && _accGyro.getEvent(&linearAccelData, Adafruit_BNO055::VECTOR_LINEARACCEL) && _accGyro.getEvent(&gravityData, Adafruit_BNO055::VECTOR_GRAVITY);
+  i2cScheduler.endTransaction(I2cDevice::IMU, start);
+  if (!received) {
+    return false;
+  }
+  processData(&angVelocityData, sample);
+  processData(&linearAccelData, sample);
+  processData(&gravityData, sample);
+  return true;
+}
+
+void BNO055IMUSensor::printSensorStats(unsigned long elapsed) {
+  debug(" burst fails: ");
+  debug(_burstFailCount - _reportedBurstFails);
+  if (_useInterrupts) {
+    debug(" reads saved/min: ");
+    debug((_skippedReads - _reportedSkippedReads) * 60000.0 / elapsed);
+  }
+  _reportedBurstFails = _burstFailCount;
+  _reportedSkippedReads = _skippedReads;
+}
+
+volatile bool BNO055IMUSensor::_interruptPending = false;
+
+void IRAM_ATTR BNO055IMUSensor::onMotionInterrupt() {
+  _interruptPending = true;  //no I2C in the ISR, handled in update()
+}
+
+bool BNO055IMUSensor::enableMotionInterrupts(int8_t intPin) {
+  if (intPin < 0) {
+    return false;  //INT not connected, keep polling
+  }
+  _intPin = intPin;  //before configureMotionEngine(), which routes the interrupts to the pin
+  configureMotionEngine();
+
+  pinMode(_intPin, INPUT);
+  attachInterrupt(digitalPinToInterrupt(_intPin), onMotionInterrupt, RISING);
+  writeRegister(BNO055_REG_SYS_TRIGGER, BNO055_SYS_TRIGGER_CLK_SEL | BNO055_SYS_TRIGGER_RST_INT);  //start unlatched
+  _motionActive = true;  //poll until the first no-motion interrupt
+  _useInterrupts = true;
+  debug("IMU motion interrupts enabled on GPIO ");
+  debugln(_intPin);
+  return true;
+}
+
+// Interrupt settings can only be written in config mode. Own register writes, so it also works after
+// a warm resume, where the Adafruit driver is not started
+void BNO055IMUSensor::configureMotionEngine(bool sleeping) {
+  i2cScheduler.lockBus();  //no sample reads in config mode or on page 1
+  writeRegister(BNO055_REG_OPR_MODE, OPERATION_MODE_CONFIG);
+  delay(25);
+  writeRegister(BNO055_REG_PAGE_ID, 1);
+  writeRegister(BNO055_REG_ACC_AM_THRES, BNO055_MOTION_THRESHOLD);
+  writeRegister(BNO055_REG_ACC_NM_THRES, BNO055_MOTION_THRESHOLD);
+  writeRegister(BNO055_REG_ACC_INT_SETTINGS, 0b00011100);           //x, y and z axis, any-motion duration 1 sample
+  writeRegister(BNO055_REG_ACC_NM_SET, (BNO055_NM_DURATION << 1) | 1);  //no-motion (not slow-motion)
+  writeRegister(BNO055_REG_INT_MSK, _intPin >= 0 ? BNO055_INT_ACC_AM | BNO055_INT_ACC_NM : 0);  //route to the INT pin
+  writeRegister(BNO055_REG_INT_EN, BNO055_INT_ACC_AM | BNO055_INT_ACC_NM);
+  writeRegister(BNO055_REG_PAGE_ID, 0);
+  writeRegister(BNO055_REG_PWR_MODE, sleeping ? BNO055_PWR_MODE_LOW_POWER : BNO055_PWR_MODE_NORMAL);
+  writeRegister(BNO055_REG_OPR_MODE, sleeping ? OPERATION_MODE_ACCONLY : OPERATION_MODE_NDOF);
+  delay(20);
+  i2cScheduler.unlockBus();
+}
+
+uint8_t BNO055IMUSensor::handleMotionInterrupt() {
+  _interruptPending = false;
+  uint8_t flags = 0;
+  i2cScheduler.lockBus();
+  uint8_t status = readRegister(BNO055_REG_INT_STA);  //cleared on read
+  if (status & BNO055_INT_ACC_AM) {
+    _motionActive = true;
+    flags = SAMPLE_ANY_MOTION;
+  } else if (status & BNO055_INT_ACC_NM) {
+    _motionActive = false;
+    _lastCheckRead = millis();
+    flags = SAMPLE_NO_MOTION;
+  }
+  writeRegister(BNO055_REG_SYS_TRIGGER, BNO055_SYS_TRIGGER_CLK_SEL | BNO055_SYS_TRIGGER_RST_INT);  //release the latched INT pin
+  i2cScheduler.unlockBus();
+  return flags;
+}
+
+void BNO055IMUSensor::writeRegister(uint8_t reg, uint8_t value) {
+  int64_t start = i2cScheduler.beginTransaction(I2cDevice::IMU);
+  Wire.beginTransmission(BNO055_I2C_ADDRESS);
+  Wire.write(reg);
+  Wire.write(value);
+  Wire.endTransmission();
+  i2cScheduler.endTransaction(I2cDevice::IMU, start);
+}
+
+uint8_t BNO055IMUSensor::readRegister(uint8_t reg) {
+  int64_t start = i2cScheduler.beginTransaction(I2cDevice::IMU);
+  Wire.beginTransmission(BNO055_I2C_ADDRESS);
+  Wire.write(reg);
+  Wire.endTransmission(false);
+  Wire.requestFrom((uint8_t)BNO055_I2C_ADDRESS, (uint8_t)1);
+  uint8_t value = Wire.read();
+  i2cScheduler.endTransaction(I2cDevice::IMU, start);
+  return value;
 }
 
-void BNO055IMUSensor::processData(sensors_event_t *event) {
+void BNO055IMUSensor::processData(sensors_event_t *event, ImuSample &sample) {
   switch (event->type) {
     case SENSOR_TYPE_LINEAR_ACCELERATION:
-      _ax = event->acceleration.x;
-      _ay = event->acceleration.y;
-      _az = event->acceleration.z;
-
-      // Calculate the magnitude of the linear acceleration
-      _magnitude = sqrt(_ax * _ax + _ay * _ay + _az * _az);
-      // debug("Acc read: ");
-      // debug(_ax);
-      // debug(", ");
-      // debug(_ay);
-      // debug(", ");
-      // debug(_az);
-      // debugln();
+      sample.ax = event->acceleration.x;
+      sample.ay = event->acceleration.y;
+      sample.az = event->acceleration.z;
       break;
 
     case SENSOR_TYPE_GYROSCOPE:
-      _xGyro = event->gyro.x;
-      _yGyro = event->gyro.y;
-      _zGyro = event->gyro.z;
-      // debug("Gyro read: ");
-      // debug(_xGyro, 4);
-      // debug(", ");
-      // debug(_yGyro, 4);
-      // debug(", ");
-      // debug(_zGyro, 4);
-      // debugln();
+      sample.xGyro = event->gyro.x;
+      sample.yGyro = event->gyro.y;
+      sample.zGyro = event->gyro.z;
       break;
 
     case SENSOR_TYPE_GRAVITY:
-      _xGravity = event->acceleration.x;
-      _yGravity = event->acceleration.y;
-      _zGravity = event->acceleration.z;
-      // debug("Gravity read: ");
-      // debug(_xGravity, 4);
-      // debug(", ");
-      // debug(_yGravity, 4);
-      // debug(", ");
-      // debug(_zGravity, 4);
-      // debugln();
+      sample.xGravity = event->acceleration.x;
+      sample.yGravity = event->acceleration.y;
+      sample.zGravity = event->acceleration.z;
       break;
   }
 }
@@ -1,22 +1,82 @@
 #ifndef IMUHELPERS_H_
 #define IMUHELPERS_H_
 
+#include <Arduino.h>
 #include <Wire.h>
+#include <esp_timer.h>
 #include <Adafruit_Sensor.h>
+#include "RingBuffer.h"
+#include "ThrowRecorder.h"
 
 #define LOWERBOUND 9.0  //g-values boundaries for axis detection
 #define UPPERBOUND 10.50
 #define TWOPI 6.2831853072
 
+#define IMU_SAMPLE_INTERVAL 10            //ms, fixed sample rate of the sampler task (BNO055 fusion runs at 100 Hz)
+#define IMU_RING_SIZE 129                 //ring capacity 128 samples, 1.28 s at 100 Hz: covers the longest screen refresh
+#define IMU_STATS_WINDOW 1000             //samples per published jitter statistics window
+#define IMU_SAMPLER_STACK 4096
+#define IMU_SAMPLER_PRIORITY 3            //above the Arduino loop task
+#define IMU_SAMPLER_CORE 0                //loop() runs on core 1
+#define SAMPLE_RATE_REPORT_INTERVAL 10000  //ms between IMU statistics reports
+
+// Windowed rest detector: settled as soon as the last REST_WINDOW samples are quiet and agree on the axis
+#define REST_WINDOW 8                     //samples, 80 ms at 100 Hz
+#define REST_GYRO_LIMIT 0.2               //rad/s, maximum rotation speed at rest
+#define REST_GRAVITY_VARIANCE 0.02        //(m/s2)^2, maximum summed variance of the gravity vector
+
+// Drift correction while settled
+#define GYRO_BIAS_ALPHA 0.01   //bias low pass per sample, ~1 s time constant at 100 Hz
+#define GYRO_BIAS_LIMIT 0.05   //rad/s, larger offsets are treated as real rotation, not bias
+#define GRAVITY_PULL 0.02      //fraction of the up vector error corrected per sample
+
+// One timestamped IMU reading
+struct ImuSample {
+  int64_t timeUs;              //esp_timer time of the read, does not wrap
+  float xGyro, yGyro, zGyro;   //rad/s
+  float ax, ay, az;            //linear acceleration m/s2
+  float xGravity, yGravity, zGravity;
+  uint8_t flags;               //SAMPLE_* bits
+};
+
+// Motion interrupt events, carried by the sample read right after them, and skipped reads
+#define SAMPLE_ANY_MOTION 0x01   //any-motion interrupt
+#define SAMPLE_NO_MOTION 0x02    //no-motion interrupt
+#define SAMPLE_POLLING 0x04      //interrupts given up, the sensor is read every sample again
+#define SAMPLE_REST 0x08         //not read, repeats the last gravity: zero rotation, no bias update
+
+// Motion as reported by the sensor's interrupt engine. UNKNOWN without interrupts (polling)
+enum class MotionState : uint8_t { UNKNOWN, MOVING, STILL };
+
+// Sample interval statistics of the sampler task, published once per IMU_STATS_WINDOW samples
+struct SamplerStats {
+  unsigned long samples;
+  unsigned long late;       //intervals longer than 1.5 x the nominal interval
+  uint32_t minInterval;     //us
+  uint32_t meanInterval;
+  uint32_t maxInterval;
+  uint32_t meanReadTime;    //us spent in readSample()
+  uint32_t maxReadTime;
+};
+
 class IMUSensor {
 public:
   virtual ~IMUSensor() {}
 
   // Sensor specific functions
   virtual void init() {}
-  virtual void update() {}
+  virtual void resume() {  //after a warm sleep (WarmSleep.h), the sensor stayed powered
+    init();
+  }
+  virtual void prepareSleep() {}  //arm the motion wake before a warm sleep
+  virtual uint8_t getCalibrationStatus() {  //sensor specific, 0 when unknown
+    return 0;
+  }
 
   // Independent functions
+  void update();  //consume the samples taken since the last call
+  void startSampler(uint32_t intervalMs);
+  void stopSampler();  //waits until the sampler task has finished its current read
   void reset();
   //void measureBias();
   bool tumbled(float minRotation);
@@ -24,6 +84,19 @@ public:
   bool isNotMoving() {
     return !isMoving();
   }
+  bool isSettled() const;
+  bool isAtRest() const {  //settled by the window statistics or still for stableTime
+    return isSettled() || !(_isMoving || (clockMs() - _lastMovementTime <= stableTime));
+  }
+  void getRestGravity(float &xGravity, float &yGravity, float &zGravity) const;
+  MotionState motionState() const {
+    return _motionState;
+  }
+  bool takeMotionStop() {  //no-motion interrupt since the last call
+    bool stopped = _motionStop;
+    _motionStop = false;
+    return stopped;
+  }
 
   float getXGravity() const {
     return _xGravity;
@@ -35,43 +108,190 @@ public:
     return _zGravity;
   }
 
+  // Motion thresholds, adjustable at runtime for tuning (see SerialCommands.h)
+  float getThreshold() const {
+    return threshold;
+  }
+  void setThreshold(float value) {
+    threshold = value;
+  }
+  unsigned long getStableTime() const {
+    return stableTime;
+  }
+  void setStableTime(unsigned long value) {
+    stableTime = value;
+  }
+
+  ThrowRecorder &getRecorder() {
+    return _recorder;
+  }
+
+  const SamplerStats &getSamplerStats() const {
+    return _samplerStats;
+  }
+  unsigned long getDroppedSamples() const {
+    return _samples.droppedCount();
+  }
+
 protected:
-  virtual void processData(sensors_event_t *event) {}
-  void updateUpVector(double deltaTime);
+  virtual bool readSample(ImuSample &sample) {  //false when no new data is available
+    return false;
+  }
+  virtual void printSensorStats(unsigned long elapsed) {}
+  void processSample(const ImuSample &sample);
+  void updateUpVector(float deltaTime);
+  void getUpVector(float &xUp, float &yUp, float &zUp) const;
+  void correctDrift(float rawXGyro, float rawYGyro, float rawZGyro);
+  int64_t clockUs() const {  //esp_timer time, or the sample time of an offline run
+    return _offline ? _offlineTimeUs : esp_timer_get_time();
+  }
+  unsigned long clockMs() const {  //same clock as millis()
+    return (unsigned long)(clockUs() / 1000);
+  }
+
+private:
+  static void samplerTask(void *parameter);
+  void takeSample();
+  void reportStats();
 
 protected:
-  const float threshold = 1.6; //maximum acceleration to indicate stable
-  const unsigned long stableTime = 200;  //ms)
+  float threshold = 1.6; //maximum acceleration to indicate stable
+  unsigned long stableTime = 200;  //ms)
 
-  unsigned long _prevMicros;
+  int64_t _prevSampleTime = 0;
   unsigned long _lastMovementTime;
 
-  double _xUp, _yUp, _zUp;
-  double _xUpStart, _yUpStart, _zUpStart;
- // double _xGyroBias, _yGyroBias, _zGyroBias;
+  // Orientation since reset() as a unit quaternion, single precision (ESP32-S3 FPU is float only)
+  float _qw = 1.0f, _qx = 0.0f, _qy = 0.0f, _qz = 0.0f;
+  float _xUpStart, _yUpStart, _zUpStart;  //unit up vector at reset()
+
+  // tumbled() compares the dot product against a cached cosine instead of calling acos
+  float _tumbleMinRotation = -1.0f;
+  float _tumbleCosLimit = -1.0f;
+  // Gyro bias, learned while settled and subtracted before integration. Loop only, the sampler never reads it
+  float _xGyroBias = 0.0f, _yGyroBias = 0.0f, _zGyroBias = 0.0f;
 
-  float _xGyro, _yGyro, _zGyro;
+  float _xGyro, _yGyro, _zGyro;  //bias corrected
   float _xGravity, _yGravity, _zGravity;
   float _ax, _ay, _az, _magnitude;
   // float _xRotationMagnitude, _yRotationMagnitude, _zRotationMagnitude;
 
   bool _isMoving;
+
+  // last REST_WINDOW samples for the rest detector
+  float _restGravity[REST_WINDOW][3];
+  float _restGyro[REST_WINDOW];      //rotation speed
+  float _restMagnitude[REST_WINDOW];  //linear acceleration
+  uint8_t _restIndex = 0;
+  uint8_t _restCount = 0;
+
+  ThrowRecorder _recorder;  //last seconds of samples for diagnostics
+
+  // Offline run faster than real time (SyntheticIMU.h): time comes from the samples, no recorder or profiler
+  bool _offline = false;
+  int64_t _offlineTimeUs = 0;
+
+private:
+  // Fixed rate sampler. Without it update() reads one sample per call (polling)
+  RingBuffer<ImuSample, IMU_RING_SIZE> _samples;
+  TaskHandle_t _samplerTask = nullptr;
+  volatile bool _stopSampler = false;
+  uint32_t _sampleInterval = 0;
+
+  // written by the sampler task only
+  int64_t _lastSampleTime = 0;
+  SamplerStats _windowStats = {};
+  uint64_t _windowIntervalTotal = 0;
+  uint64_t _windowReadTimeTotal = 0;
+  SamplerStats _samplerStats = {};
+
+  // written by the loop only
+  MotionState _motionState = MotionState::UNKNOWN;
+  bool _motionStop = false;
+  unsigned long _processedSamples = 0;
+  unsigned long _reportedSamples = 0;
+  unsigned long _reportedDropped = 0;
+  unsigned long _lastReport = 0;
 };
 
 #include <Adafruit_BNO055.h>
 #include <utility/imumaths.h>
 
+#define BNO055_I2C_ADDRESS 0x28
+#define BNO055_I2C_CLOCK 400000         //BNO055 supports fast mode
+#define IMU_GRAVITY_TIMEOUT 1000         //ms to wait for the first valid gravity vector after init
+#define BNO055_BURST_START_ADDR 0x14     //GYR_DATA_X_LSB, first register of the burst
+#define BNO055_BURST_LENGTH 32           //gyro 0x14..0x19, euler, quaternion, linear acc 0x28..0x2D, gravity 0x2E..0x33
+#define BNO055_GYRO_LSB_PER_DPS 16.0f    //same scaling as Adafruit_BNO055::getVector
+#define BNO055_ACC_LSB_PER_MS2 100.0f
+
+// Any-motion / no-motion interrupt engine (register page 1)
+#define BNO055_REG_PAGE_ID 0x07
+#define BNO055_REG_INT_STA 0x37          //page 0
+#define BNO055_REG_SYS_TRIGGER 0x3F      //page 0
+#define BNO055_REG_OPR_MODE 0x3D         //page 0
+#define BNO055_REG_PWR_MODE 0x3E         //page 0, written in config mode
+#define BNO055_PWR_MODE_NORMAL 0x00
+#define BNO055_PWR_MODE_LOW_POWER 0x01   //accelerometer only after the no-motion time, any-motion wakes the sensor
+#define BNO055_REG_CALIB_STAT 0x35       //page 0, 2 bits each: system, gyro, accel, mag
+#define BNO055_REG_INT_MSK 0x0F          //page 1
+#define BNO055_REG_INT_EN 0x10
+#define BNO055_REG_ACC_AM_THRES 0x11
+#define BNO055_REG_ACC_INT_SETTINGS 0x12
+#define BNO055_REG_ACC_NM_THRES 0x15
+#define BNO055_REG_ACC_NM_SET 0x16
+#define BNO055_INT_ACC_AM 0x40
+#define BNO055_INT_ACC_NM 0x80
+#define BNO055_SYS_TRIGGER_RST_INT 0x40
+#define BNO055_SYS_TRIGGER_CLK_SEL 0x80  //keep the external crystal selected when resetting the interrupt
+#define BNO055_MOTION_THRESHOLD 9        //LSB of 7.81 mg (4G range): ~0.7 m/s2, like MOVINGTHRESHOLD
+#define BNO055_NM_DURATION 0             //0 = 1 s without motion
+#define MOTION_CHECK_INTERVAL 1000       //ms, fallback read while at rest to detect a dead interrupt line
+
 class BNO055IMUSensor : public IMUSensor {
 public:
   void init() override;
-  void update() override;
-  void processData(sensors_event_t *event) override;
+  void resume() override;
+  void prepareSleep() override;
+  uint8_t getCalibrationStatus() override;
+
+  bool enableMotionInterrupts(int8_t intPin);
+  static void onMotionInterrupt();  //ISR on the INT pin. A host mock can call it to inject an edge
+
+protected:
+  bool readSample(ImuSample &sample) override;
+  void printSensorStats(unsigned long elapsed) override;
 
 private:
-  Adafruit_BNO055 _accGyro;
+  bool burstRead(ImuSample &sample);
+  bool eventRead(ImuSample &sample);
+  void processData(sensors_event_t *event, ImuSample &sample);
+  uint8_t handleMotionInterrupt();  //SAMPLE_ANY_MOTION or SAMPLE_NO_MOTION
+  void configureMotionEngine(bool sleeping = false);  //sleeping: accelerometer only in low power mode
+  void waitForGravity();
+  static void writeRegister(uint8_t reg, uint8_t value);
+  static uint8_t readRegister(uint8_t reg);
   void restoreCalibrationData();
   void displaySensorOffsets(const adafruit_bno055_offsets_t &calibData);
   void displayCalStatus(void);
+
+private:
+  Adafruit_BNO055 _accGyro;
+  bool _driverStarted = false;  //not after a warm resume: the driver's begin() resets the sensor
+
+  // written by the sampler task, reported as differences by the loop
+  unsigned long _burstFailCount = 0;
+  unsigned long _skippedReads = 0;       //reads saved by the motion interrupts
+  unsigned long _reportedBurstFails = 0;
+  unsigned long _reportedSkippedReads = 0;
+  ImuSample _restSample = {};            //returned instead of a read while at rest
+
+  // motion interrupts. Without them every update() reads the sensor (polling)
+  static volatile bool _interruptPending;
+  bool _useInterrupts = false;
+  bool _motionActive = true;  //between any-motion and no-motion interrupt
+  int8_t _intPin = -1;
+  unsigned long _lastCheckRead = 0;
 };
 
 #endif /* IMUHELPERS_H_ */
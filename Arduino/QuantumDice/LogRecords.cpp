@@ -0,0 +1,106 @@
+#include "LogRecords.h"
+#include <stdio.h>
+#include "DiceOutcome.h"
+
+static const char *const formatTexts[] = {
+#define LOG_FORMAT_TEXT(id, text) text,
+  LOG_FORMATS(LOG_FORMAT_TEXT)
+#undef LOG_FORMAT_TEXT
+};
+
+const char *logFormatText(uint8_t format) {
+  return format < (uint8_t)LogFormat::COUNT ? formatTexts[format] : nullptr;
+}
+
+const char *stateName(State state) {
+  switch (state) {
+    case State::IDLE: return "IDLE";
+    case State::INITSINGLE: return "INITSINGLE";
+    case State::INITENTANGLED_AB1: return "INITENTANGLED_AB1";
+    case State::INITENTANGLED_AB2: return "INITENTANGLED_AB2";
+    case State::INITSINGLE_AFTER_ENT: return "INITSINGLE_AFTER_ENT";
+    case State::WAITFORTHROW: return "WAITFORTHROW";
+    case State::THROWING: return "THROWING";
+    case State::INITMEASURED: return "INITMEASURED";
+    case State::LOWBATTERY: return "LOWBATTERY";
+    case State::CLASSIC_STATE: return "CLASSIC_STATE";
+    default: return "?";
+  }
+}
+
+const char *diceStateName(DiceStates diceState) {
+  switch (diceState) {
+    case DiceStates::SINGLE: return "SINGLE";
+    case DiceStates::ENTANGLED_AB1: return "ENTANGLED_AB1";
+    case DiceStates::ENTANGLED_AB2: return "ENTANGLED_AB2";
+    case DiceStates::UN_ENTANGLED_AB1: return "UN_ENTANGLED_AB1";
+    case DiceStates::UN_ENTANGLED_AB2: return "UN_ENTANGLED_AB2";
+    case DiceStates::MEASURED: return "MEASURED";
+    case DiceStates::MEASURED_AFTER_ENT: return "MEASURED_AFTER_ENT";
+    case DiceStates::ALL: return "ALL";
+    case DiceStates::NONE: return "NONE";
+    case DiceStates::CLASSIC: return "CLASSIC";
+    default: return "?";
+  }
+}
+
+const char *upSideName(UpSide upSide) {
+  switch (upSide) {
+    case UpSide::X0: return "X0";
+    case UpSide::X1: return "X1";
+    case UpSide::Y0: return "Y0";
+    case UpSide::Y1: return "Y1";
+    case UpSide::Z0: return "Z0";
+    case UpSide::Z1: return "Z1";
+    case UpSide::NONE: return "NONE";
+    default: return "?";
+  }
+}
+
+// Same text as the format would give with printf; missing arguments print as 0
+size_t expandLogRecord(const LogRecord &record, char *text, size_t size) {
+  if (size == 0) {
+    return 0;
+  }
+  const char *format = logFormatText(record.format);
+  if (!format) {
+    int written = snprintf(text, size, "log record %u", record.format);
+    return written < (int)size ? written : size - 1;
+  }
+  size_t length = 0;
+  uint8_t arg = 0;
+  for (const char *c = format; *c && length < size - 1; c++) {
+    if (*c != '%' || c[1] == '\0') {
+      text[length++] = *c;
+      continue;
+    }
+    c++;
+    uint32_t word = arg < record.argCount && arg < LOG_RECORD_ARGS ? record.args[arg] : 0;
+    char field[24];
+    const char *value = field;
+    switch (*c) {
+      case 'd': snprintf(field, sizeof(field), "%ld", (long)(int32_t)word); break;
+      case 'u': snprintf(field, sizeof(field), "%lu", (unsigned long)word); break;
+      case 'x': snprintf(field, sizeof(field), "%lx", (unsigned long)word); break;
+      case 'f': {
+        float number;
+        memcpy(&number, &word, sizeof(number));
+        snprintf(field, sizeof(field), "%.2f", number);  //two decimals like Print
+        break;
+      }
+      case 'S': value = stateName((State)word); break;
+      case 'D': value = diceStateName((DiceStates)word); break;
+      case 'U': value = upSideName((UpSide)word); break;
+      case 'R': value = outcomeRuleName((OutcomeRule)word); break;
+      default:  //"%%" or an unknown specifier: printed as is, no argument used
+        text[length++] = *c;
+        continue;
+    }
+    arg++;
+    for (; *value && length < size - 1; value++) {
+      text[length++] = *value;
+    }
+  }
+  text[length] = '\0';
+  return length;
+}
@@ -0,0 +1,64 @@
+#ifndef LOGRECORDS_H_
+#define LOGRECORDS_H_
+
+// Binary log records: a hot path logs a format ID and up to LOG_RECORD_ARGS raw 32 bit arguments
+// (debugRecord() in defines.h) instead of formatting text. The format strings live only in this table,
+// which the firmware and the host decoder (../HostTools/LogDecoder.cpp) both compile, so the IDs cannot
+// go out of sync. Append new formats at the end; an ID is the position in the table.
+// Specifiers: %d %u %x (32 bit), %f (float), %S State, %D DiceStates, %U UpSide, %R OutcomeRule, %% a percent sign.
+// No Arduino or firmware includes, like DiceOutcome.h.
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "DiceTypes.h"
+
+#define LOG_RECORD_ARGS 7
+#define LOG_RECORD_MARKER 0x1E  //ASCII record separator, starts a binary record in the serial stream (LOG_BINARY)
+
+#define LOG_FORMATS(X) \
+  X(STATE_CHANGE, "stateMachine: %S") \
+  X(STATE_ENTER, "------------ enter %S state ------------- diceState %D, previous %D") \
+  X(STATE_EXIT, "------------ exit %S state ------------- diceState %D, previous %D") \
+  X(DICE_STATE, "DiceState: %D") \
+  X(TUMBLE, "tumble: start up (%f, %f, %f), up (%f, %f, %f), rotation %f") \
+  X(MEASURE_GRAVITY, "gravity XYZ: %f, %f, %f") \
+  X(MEASURE_ORIENTATION, "upside %U, orientation margin %f") \
+  X(MEASURE_RULE, "secret sauce rule: %R") \
+  X(RENDER, "render screen state %u on faces 0x%x")
+
+enum class LogFormat : uint8_t {
+#define LOG_FORMAT_ID(id, text) id,
+  LOG_FORMATS(LOG_FORMAT_ID)
+#undef LOG_FORMAT_ID
+  COUNT
+};
+
+// Frame on the wire: LOG_RECORD_MARKER, format, argCount, argCount little endian 32 bit words
+struct LogRecord {
+  uint8_t format;
+  uint8_t argCount;
+  uint32_t args[LOG_RECORD_ARGS];
+};
+
+// Raw argument words: floats by their bits, enums and integers by value
+inline uint32_t logWord(float value) {
+  uint32_t word;
+  memcpy(&word, &value, sizeof(word));
+  return word;
+}
+inline uint32_t logWord(double value) {
+  return logWord((float)value);
+}
+template <typename T>
+inline uint32_t logWord(T value) {
+  return (uint32_t)value;
+}
+
+const char *logFormatText(uint8_t format);  //nullptr for an unknown ID
+size_t expandLogRecord(const LogRecord &record, char *text, size_t size);  //text without newline, returns its length
+
+const char *stateName(State state);
+const char *diceStateName(DiceStates diceState);
+const char *upSideName(UpSide upSide);
+
+#endif /* LOGRECORDS_H_ */
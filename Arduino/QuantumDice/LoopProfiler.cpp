@@ -0,0 +1,112 @@
+#define LOG_MODULE LOG_PROF
+#include "defines.h"
+#include "LoopProfiler.h"
+
+LoopProfiler loopProfiler;
+
+static const char *stageName(uint8_t stage) {
+  switch ((LoopStage)stage) {
+    case LoopStage::RADIO: return "radio";
+    case LoopStage::IMU: return "imu";
+    case LoopStage::STATE: return "state";
+    case LoopStage::SLEEP: return "sleep";
+    default: return "?";
+  }
+}
+
+void Histogram::add(uint32_t us) {
+  uint8_t bucket = us ? min(32 - __builtin_clz(us), PROFILE_BUCKETS - 1) : 0;
+  counts[bucket]++;
+  samples++;
+  total += us;
+  if (us > max) {
+    max = us;
+  }
+}
+
+void Histogram::clear() {
+  memset(this, 0, sizeof(*this));
+}
+
+// One line: name, count, mean, max, then "<upper bound us>:<count>" for the non-empty buckets
+void Histogram::print(Print &out, const char *name) const {
+  if (samples == 0) {
+    return;
+  }
+  out.printf("%-22s n=%lu mean=%lu max=%lu us |", name, (unsigned long)samples, (unsigned long)(total / samples), (unsigned long)max);
+  for (uint8_t bucket = 0; bucket < PROFILE_BUCKETS; bucket++) {
+    if (counts[bucket]) {
+      out.printf(" <%lu:%lu", 1UL << bucket, (unsigned long)counts[bucket]);
+    }
+  }
+  out.println();
+}
+
+LoopProfiler::LoopProfiler() {
+  clear();
+}
+
+void LoopProfiler::clear() {
+  _iteration.clear();
+  for (Histogram &histogram : _states) {
+    histogram.clear();
+  }
+  _imuGap.clear();
+  _imuLag.clear();
+  memset(_overBudget, 0, sizeof(_overBudget));
+}
+
+void LoopProfiler::beginIteration() {
+  _iterationStart = _stageStart = micros();
+  memset(_stageTime, 0, sizeof(_stageTime));
+}
+
+void LoopProfiler::endStage(LoopStage stage) {
+  uint32_t now = micros();
+  _stageTime[(int)stage] += now - _stageStart;
+  _stageStart = now;
+}
+
+void LoopProfiler::endIteration(State state) {
+  uint32_t duration = micros() - _iterationStart;
+  _iteration.add(duration);
+  _states[(int)state].add(_stageTime[(int)LoopStage::STATE]);
+
+  if (duration > _budget) {
+    uint8_t slowest = 0;
+    for (uint8_t stage = 1; stage < (uint8_t)LoopStage::COUNT; stage++) {
+      if (_stageTime[stage] > _stageTime[slowest]) {
+        slowest = stage;
+      }
+    }
+    _overBudget[slowest]++;
+    debug("loop over budget: ");
+    debug(duration);
+    debug(" us, slowest stage ");
+    debug(stageName(slowest));
+    debug(" in ");
+    debugln(stateName(state));
+  }
+}
+
+void LoopProfiler::addImuSample(int64_t sampleTimeUs, int64_t nowUs) {
+  if (_prevSampleTime != 0) {
+    _imuGap.add((uint32_t)(sampleTimeUs - _prevSampleTime));
+  }
+  _prevSampleTime = sampleTimeUs;
+  _imuLag.add((uint32_t)(nowUs - sampleTimeUs));
+}
+
+void LoopProfiler::print(Print &out) const {
+  _iteration.print(out, "update()");
+  for (int state = 0; state < (int)State::COUNT; state++) {
+    _states[state].print(out, stateName((State)state));
+  }
+  _imuGap.print(out, "imu sample gap");
+  _imuLag.print(out, "imu processing lag");
+  out.printf("budget %lu us, over budget by stage:", (unsigned long)_budget);
+  for (uint8_t stage = 0; stage < (uint8_t)LoopStage::COUNT; stage++) {
+    out.printf(" %s=%lu", stageName(stage), (unsigned long)_overBudget[stage]);
+  }
+  out.println();
+}
@@ -0,0 +1,63 @@
+#ifndef LOOPPROFILER_H_
+#define LOOPPROFILER_H_
+
+// Loop profiler: log2 histograms of StateMachine::update() iterations, of whileInState per state and of
+// the IMU sample gap and processing lag. Iterations over the budget are reported with the slowest stage.
+// Printed by the "prof" serial command.
+#include <Arduino.h>
+#include "StateMachine.h"
+
+#define PROFILE_BUCKETS 24          //bucket n counts durations of 2^(n-1) .. 2^n - 1 us, the last one everything above
+#define LOOP_BUDGET_US 20000        //default budget per update() iteration
+
+struct Histogram {
+  uint32_t counts[PROFILE_BUCKETS];
+  uint32_t samples;
+  uint32_t max;    //us
+  uint64_t total;  //us
+
+  void add(uint32_t us);
+  void clear();
+  void print(Print &out, const char *name) const;
+};
+
+enum class LoopStage : uint8_t {
+  RADIO,  //ESP-NOW message polling
+  IMU,    //consuming the IMU samples
+  STATE,  //whileInState, including the state changes and renders it triggers
+  SLEEP,  //battery monitor, governor and power manager, deep sleep check
+  COUNT
+};
+
+class LoopProfiler {
+public:
+  LoopProfiler();
+
+  void beginIteration();
+  void endStage(LoopStage stage);
+  void endIteration(State state);
+  void addImuSample(int64_t sampleTimeUs, int64_t nowUs);  //processed sample, for gap and lag
+
+  void setBudget(uint32_t us) {
+    _budget = us;
+  }
+  void clear();
+  void print(Print &out) const;
+
+private:
+  Histogram _iteration;
+  Histogram _states[(int)State::COUNT];
+  Histogram _imuGap;  //time between consecutive samples
+  Histogram _imuLag;  //time between taking and processing a sample
+  uint32_t _overBudget[(int)LoopStage::COUNT];  //iterations over budget, by slowest stage
+
+  uint32_t _budget = LOOP_BUDGET_US;
+  uint32_t _iterationStart = 0;
+  uint32_t _stageStart = 0;
+  uint32_t _stageTime[(int)LoopStage::COUNT];
+  int64_t _prevSampleTime = 0;
+};
+
+extern LoopProfiler loopProfiler;
+
+#endif /* LOOPPROFILER_H_ */
@@ -0,0 +1,135 @@
+#define LOG_MODULE LOG_MAIN
+#include "defines.h"
+#include "MemoryBudget.h"
+#include <esp_heap_caps.h>
+#include "IMUhelpers.h"
+#include "EspNowSensor.h"
+#include "Screenfunctions.h"
+#include "DeferredLog.h"
+#include "LoopProfiler.h"
+#include "TracePoints.h"
+#include "I2CScheduler.h"
+#include "WarmSleep.h"
+
+extern "C" int _data_start, _data_end, _bss_start, _bss_end;  //linker script
+
+#if ALLOCATION_CHECK == 1
+static unsigned long checkedIterations = 0;
+static volatile uint32_t checkedAllocations = 0;
+#endif
+
+#if ALLOCATION_HOOK == 1
+static TaskHandle_t checkedTask = nullptr;     //the loop task, set by the first check
+static volatile bool checkArmed = false;
+
+// Called by the heap after every allocation, from any task and with interrupts possibly off: no logging here.
+// Counting allocations instead of comparing allocated blocks also catches a block freed in the same iteration
+extern "C" void IRAM_ATTR esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps) {
+  if (checkedTask && xTaskGetCurrentTaskHandle() == checkedTask) {
+    checkedAllocations++;
+    if (checkArmed) {
+      abort();  //steady state allocation, the panic backtrace shows the caller
+    }
+  }
+}
+
+extern "C" void IRAM_ATTR esp_heap_trace_free_hook(void *ptr) {
+}
+#elif ALLOCATION_CHECK == 1
+static size_t checkedBlocks = 0;
+
+// Walks every heap block under the heap lock: only for a check build
+static size_t allocatedBlocks() {
+  multi_heap_info_t info;
+  heap_caps_get_info(&info, MALLOC_CAP_8BIT);
+  return info.allocated_blocks;
+}
+#endif
+
+// Only the loop task is checked: the Wi-Fi and ESP-NOW tasks allocate their own buffers
+void allocationCheckBegin() {
+#if ALLOCATION_HOOK == 1
+  checkedTask = xTaskGetCurrentTaskHandle();
+  checkArmed = true;
+#elif ALLOCATION_CHECK == 1
+  checkedBlocks = allocatedBlocks();
+#endif
+}
+
+// Without the hook only blocks still allocated after the iteration are seen, and blocks allocated by other
+// tasks in the meantime count as well, so a growth is logged instead of aborting
+void allocationCheckEnd(State state) {
+#if ALLOCATION_HOOK == 1
+  checkArmed = false;
+  checkedIterations++;
+#elif ALLOCATION_CHECK == 1
+  size_t blocks = allocatedBlocks();
+  checkedIterations++;
+  if (blocks > checkedBlocks) {
+    checkedAllocations += blocks - checkedBlocks;
+    debug("heap blocks +");
+    debug(blocks - checkedBlocks);
+    debug(" in loop iteration, state ");
+    debugln(stateName(state));
+  }
+#endif
+}
+
+bool allocationCounting() {
+  return ALLOCATION_HOOK == 1;
+}
+
+uint32_t loopTaskAllocations() {
+#if ALLOCATION_CHECK == 1
+  return checkedAllocations;
+#else
+  return 0;
+#endif
+}
+
+static void printSubsystem(Print &out, const char *name, size_t bytes, const char *where) {
+  out.printf("mem,subsystem,%s,%u,%s\n", name, (unsigned)bytes, where);
+}
+
+static void printHeap(Print &out, const char *name, uint32_t caps) {
+  out.printf("mem,heap,%s,%u,%u,%u,%u\n", name, (unsigned)heap_caps_get_total_size(caps), (unsigned)heap_caps_get_free_size(caps),
+             (unsigned)heap_caps_get_minimum_free_size(caps), (unsigned)heap_caps_get_largest_free_block(caps));
+}
+
+static void printStack(Print &out, const char *task, uint32_t size) {
+  TaskHandle_t handle = xTaskGetHandle(task);
+  if (handle) {  //ESP-IDF counts the stack in bytes
+    out.printf("mem,stack,%s,%lu,%u\n", task, (unsigned long)size, (unsigned)uxTaskGetStackHighWaterMark(handle));
+  }
+}
+
+void printMemoryBudget(Print &out) {
+  out.printf("mem,static,dram,%u\n", (unsigned)((uint8_t *)&_data_end - (uint8_t *)&_data_start + (uint8_t *)&_bss_end - (uint8_t *)&_bss_start));
+
+  printSubsystem(out, "canvases", canvasBytes(), "heap");
+  printSubsystem(out, "imu", sizeof(BNO055IMUSensor), "heap");  //sample ring and throw recorder
+  printSubsystem(out, "espnow", sizeof(EspNowSensor<message>), "heap");
+  printSubsystem(out, "log", LOG_BUFFER_SIZE, "heap");
+  printSubsystem(out, "logrecords", sizeof(deferredLog), "static");  //record ring and line slots
+#if TRACE_POINTS == 1
+  printSubsystem(out, "trace", sizeof(traceEvents) + sizeof(traceTasks), "static");
+#endif
+  printSubsystem(out, "profiler", sizeof(loopProfiler), "static");
+  printSubsystem(out, "i2c", sizeof(i2cScheduler), "static");
+  printSubsystem(out, "warmstate", sizeof(warmState), "rtc");
+
+  out.println("mem,heap,name,total,free,min_free,largest_block");
+  printHeap(out, "internal", MALLOC_CAP_INTERNAL);
+  printHeap(out, "psram", MALLOC_CAP_SPIRAM);
+
+  out.println("mem,stack,task,size,min_free");
+  printStack(out, "loopTask", getArduinoLoopTaskStackSize());
+  printStack(out, "imuSampler", IMU_SAMPLER_STACK);
+  printStack(out, "logDrain", LOG_DRAIN_STACK);
+  printStack(out, "i2cWorker", I2C_WORKER_STACK);
+  printStack(out, "traceWriter", TRACE_WRITER_STACK);
+
+#if ALLOCATION_CHECK == 1
+  out.printf("mem,steady,%lu,%lu,%s\n", checkedIterations, (unsigned long)checkedAllocations, ALLOCATION_HOOK ? "hook" : "blocks");
+#endif
+}
@@ -0,0 +1,28 @@
+#ifndef MEMORYBUDGET_H_
+#define MEMORYBUDGET_H_
+
+// Memory budget: static RAM, the large buffers per subsystem, heap and PSRAM use with their low water
+// marks and the stack high water mark of each firmware task, printed as CSV by the "mem" serial command.
+// With ALLOCATION_CHECK 1 in defines.h the heap allocation hook counts every allocation made by the loop
+// task, and one inside a loop iteration after setup() aborts with the backtrace of the allocating call.
+// The hook needs a core built with CONFIG_HEAP_USE_HOOKS=y; on the stock core the allocated heap blocks
+// are compared around each iteration instead and a growth is logged, without the caller.
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include "defines.h"
+#include "StateMachine.h"
+
+#if ALLOCATION_CHECK == 1 && defined(CONFIG_HEAP_USE_HOOKS)
+#define ALLOCATION_HOOK 1  //esp_heap_trace_alloc_hook: every allocation by the loop task
+#else
+#define ALLOCATION_HOOK 0  //stock core: heap block count before and after the iteration, all tasks
+#endif
+
+void printMemoryBudget(Print &out);
+
+void allocationCheckBegin();            //loop(), before the iteration
+void allocationCheckEnd(State state);   //after it
+bool allocationCounting();              //false without the allocation hook
+uint32_t loopTaskAllocations();         //allocations by the loop task since the first check, freed or not
+
+#endif /* MEMORYBUDGET_H_ */
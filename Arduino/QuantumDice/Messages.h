@@ -0,0 +1,42 @@
+#ifndef MESSAGES_H_
+#define MESSAGES_H_
+
+// ESP-NOW messages exchanged between the dice
+#include "StateMachine.h"
+#include "ScreenStateDefs.h"
+
+#define MESSAGE_VERSION 1  //bump on any change of the layout below, other versions are dropped on receive
+
+typedef enum _message_type {
+  MESSAGE_TYPE_WATCH_DOG,
+  MESSAGE_TYPE_MEASUREMENT,
+  MESSAGE_TYPE_ENTANGLE_REQUEST,
+  MESSAGE_TYPE_ENTANGLE_CONFIRM,
+  MESSAGE_TYPE_ENTANGLE_STOP,
+  MESSAGE_TYPE_PING,  //self test round trip, echoed as MESSAGE_TYPE_PONG
+  MESSAGE_TYPE_PONG
+} message_type;
+
+typedef struct _message {
+  uint8_t version = MESSAGE_VERSION;
+  message_type type;
+  Roles senderRole;
+  union _data {
+    struct _watchDogData {
+      State state;
+    } watchDog;
+    struct _measurementData {
+      State state;
+      DiceStates diceState;
+      MeasuredAxises measureAxis;
+      DiceNumbers diceNumber;
+      UpSide upSide;
+    } measurement;
+    struct _pingData {
+      uint16_t sequence;
+      uint32_t sentTime;  //us, micros() of the sender
+    } ping;
+  } data;
+} message;
+
+#endif /* MESSAGES_H_ */
@@ -0,0 +1,120 @@
+#include "MotionTuner.h"
+#include <esp_random.h>
+#include "defines.h"
+#include "SyntheticIMU.h"
+#include "FrequencyGovernor.h"
+#include "handyHelpers.h"
+
+#if DEV_TOOLS == 1
+
+static const float thresholds[] = { 0.8f, 1.2f, 1.6f, 2.0f, 2.4f, 3.0f };           //m/s2
+static const unsigned long stableTimes[] = { 100, 150, 200, 300, 400 };             //ms
+static const float tumbles[] = { 0.1f, 0.15f, 0.2f, 0.25f, 0.3f, 0.4f };            //tumbled() needs < 0.5
+
+struct TuneJob {
+  MotionParams params;
+  uint32_t events;
+  uint32_t seed;
+  SyntheticResult result;
+  float cost;
+  bool valid;
+  SemaphoreHandle_t done;
+};
+
+static void runTuneJob(TuneJob &job) {
+  job.valid = scoreSynthetic(job.params, job.events, job.seed, job.result);
+  job.cost = job.result.falseNegative * TUNE_COST_FALSE_NEGATIVE + job.result.falsePositive * TUNE_COST_FALSE_POSITIVE
+             + job.result.settleMs * TUNE_COST_SETTLE;
+}
+
+static void tuneTask(void *parameter) {
+  TuneJob *job = (TuneJob *)parameter;
+  runTuneJob(*job);
+  xSemaphoreGive(job->done);
+  vTaskDelete(NULL);
+}
+
+static void printJob(Print &out, const char *label, const TuneJob &job) {
+  out.printf("tune,%s%.2f,%lu,%.2f,%.2f,%.2f,%.0f,%.1f\n", label, job.params.threshold, job.params.stableTime, job.params.tumble,
+             job.result.falseNegative, job.result.falsePositive, job.result.settleMs, job.cost);
+}
+
+// Scores the candidates two at a time, the first of a pair on a task on core 0, the second in the loop task
+static void scoreCandidates(Print &out, TuneJob *jobs, uint8_t count, bool &parallel) {
+  for (uint8_t i = 0; i < count; i += 2) {
+    bool pair = i + 1 < count;
+    jobs[i].done = pair ? xSemaphoreCreateBinary() : NULL;
+    bool started = jobs[i].done && xTaskCreatePinnedToCore(tuneTask, "motionTune", TUNE_TASK_STACK, &jobs[i], 1, NULL, 0) == pdPASS;
+    if (!started) {
+      runTuneJob(jobs[i]);
+    }
+    if (pair) {
+      runTuneJob(jobs[i + 1]);
+    }
+    if (started) {
+      xSemaphoreTake(jobs[i].done, portMAX_DELAY);
+    } else if (pair) {
+      parallel = false;
+    }
+    if (jobs[i].done) {
+      vSemaphoreDelete(jobs[i].done);
+    }
+    for (uint8_t j = i; j < i + 2 && j < count; j++) {
+      if (jobs[j].valid) {
+        printJob(out, "", jobs[j]);
+      }
+    }
+    delay(1);  //feeds the loop task watchdog between pairs
+  }
+}
+
+void tuneMotion(Print &out, IMUSensor *live, uint32_t events, bool apply) {
+  FrequencyBoost boost(false);
+  const uint8_t maxCandidates = max(max(sizeof(thresholds) / sizeof(thresholds[0]), sizeof(stableTimes) / sizeof(stableTimes[0])),
+                                    sizeof(tumbles) / sizeof(tumbles[0]));
+  TuneJob jobs[maxCandidates];
+  TuneJob best = {};
+  best.params = { live->getThreshold(), live->getStableTime(), currentConfig.tumbleConstant };
+  best.events = events;
+  best.seed = esp_random();  //common random numbers: every candidate sees the same events
+  runTuneJob(best);
+  if (!best.valid) {
+    out.println("tune,error,no memory");
+    return;
+  }
+
+  unsigned long start = millis();
+  bool parallel = true;
+  out.println("tune,threshold,stabletime,tumble,false_negative,false_positive,settle_ms,cost");
+  printJob(out, "current,", best);
+  for (uint8_t pass = 0; pass < TUNE_PASSES; pass++) {
+    for (uint8_t parameter = 0; parameter < 3; parameter++) {
+      uint8_t count = parameter == 0 ? sizeof(thresholds) / sizeof(thresholds[0])
+                      : parameter == 1 ? sizeof(stableTimes) / sizeof(stableTimes[0])
+                                       : sizeof(tumbles) / sizeof(tumbles[0]);
+      for (uint8_t i = 0; i < count; i++) {
+        jobs[i] = best;
+        jobs[i].valid = false;
+        if (parameter == 0) jobs[i].params.threshold = thresholds[i];
+        if (parameter == 1) jobs[i].params.stableTime = stableTimes[i];
+        if (parameter == 2) jobs[i].params.tumble = tumbles[i];
+      }
+      scoreCandidates(out, jobs, count, parallel);
+      for (uint8_t i = 0; i < count; i++) {
+        if (jobs[i].valid && jobs[i].cost < best.cost) {
+          best = jobs[i];
+        }
+      }
+    }
+  }
+
+  printJob(out, "best,", best);
+  if (apply) {
+    live->setThreshold(best.params.threshold);
+    live->setStableTime(best.params.stableTime);
+    currentConfig.tumbleConstant = best.params.tumble;
+    out.println("tune,applied until reboot");
+  }
+  out.printf("tune,done,%lu ms,%s\n", millis() - start, parallel ? "2 cores" : "1 core");
+}
+#endif
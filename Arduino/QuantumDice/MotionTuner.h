@@ -0,0 +1,24 @@
+#ifndef MOTIONTUNER_H_
+#define MOTIONTUNER_H_
+
+// Search of the motion detection parameters against the synthetic events (SyntheticIMU.h), started by
+// the "tune" serial command (DEV_TOOLS). Coordinate descent over threshold, stable time and tumble constant: every
+// candidate is scored on the same event sequence (same seed), two candidates at a time, one on each core.
+// One CSV line per candidate: tune,<threshold>,<stabletime>,<tumble>,<false neg %>,<false pos %>,<settle ms>,<cost>
+#include <Arduino.h>
+#include "IMUhelpers.h"
+
+#define TUNE_DEFAULT_EVENTS 300  //per candidate, about 100 ms each on one core
+#define TUNE_PASSES 2            //coordinate descent rounds over the three parameters
+#define TUNE_TASK_STACK 6144
+
+// Cost per candidate, lower is better. A missed throw makes the player throw again, a false roll changes
+// the number without a throw, settle time delays every result
+#define TUNE_COST_FALSE_NEGATIVE 10.0f  //per %
+#define TUNE_COST_FALSE_POSITIVE 5.0f   //per %
+#define TUNE_COST_SETTLE 0.01f          //per ms
+
+// apply: set the best parameters on the live sensor until reboot, as "set" would
+void tuneMotion(Print &out, IMUSensor *live, uint32_t events, bool apply);
+
+#endif /* MOTIONTUNER_H_ */
@@ -0,0 +1,77 @@
+#include "Orientation.h"
+#include <math.h>
+#include <string.h>
+#include "IMUhelpers.h"  //LOWERBOUND, UPPERBOUND
+
+// IMU mounted on X+ side (left): sensor X -> dice Z, sensor -Y -> dice X, sensor -Z -> dice Y
+static const int8_t nanoMounting[MOUNTING_SIZE] = {
+  0, -1, 0,
+  0, 0, -1,
+  1, 0, 0
+};
+
+// IMU mounted on Y- side (rear): sensor Z -> dice X, sensor -Y -> dice Y, sensor X -> dice Z
+static const int8_t devkitMounting[MOUNTING_SIZE] = {
+  0, 0, 1,
+  0, -1, 0,
+  1, 0, 0
+};
+
+static const MeasuredAxises diceAxes[3] = { MeasuredAxises::XAXIS, MeasuredAxises::YAXIS, MeasuredAxises::ZAXIS };
+static const UpSide faceZero[3] = { UpSide::X0, UpSide::Y0, UpSide::Z0 };
+static const UpSide faceOne[3] = { UpSide::X1, UpSide::Y1, UpSide::Z1 };
+
+Orientation classifyOrientation(const int8_t mounting[MOUNTING_SIZE], float xGravity, float yGravity, float zGravity) {
+  float dice[3];
+  uint8_t strongest = 0;
+  for (uint8_t row = 0; row < 3; row++) {
+    const int8_t *m = &mounting[row * 3];
+    dice[row] = m[0] * xGravity + m[1] * yGravity + m[2] * zGravity;
+    if (fabsf(dice[row]) > fabsf(dice[strongest])) {
+      strongest = row;
+    }
+  }
+
+  float second = 0.0f;
+  for (uint8_t row = 0; row < 3; row++) {
+    if (row != strongest && fabsf(dice[row]) > second) {
+      second = fabsf(dice[row]);
+    }
+  }
+
+  Orientation orientation = { MeasuredAxises::UNDEFINED, UpSide::NONE, fabsf(dice[strongest]) - second };
+  float g = fabsf(dice[strongest]);
+  if (g >= LOWERBOUND && g <= UPPERBOUND) {
+    orientation.axis = diceAxes[strongest];
+    orientation.upSide = dice[strongest] > 0 ? faceZero[strongest] : faceOne[strongest];
+  }
+  return orientation;
+}
+
+bool validMountingMatrix(const int8_t mounting[MOUNTING_SIZE]) {
+  // exactly one non-zero entry of +-1 per row and per column
+  uint8_t columnsUsed = 0;
+  for (uint8_t row = 0; row < 3; row++) {
+    uint8_t nonZero = 0;
+    for (uint8_t col = 0; col < 3; col++) {
+      int8_t v = mounting[row * 3 + col];
+      if (v == 0) continue;
+      if (v != 1 && v != -1) return false;
+      if (columnsUsed & (1 << col)) return false;
+      columnsUsed |= (1 << col);
+      nonZero++;
+    }
+    if (nonZero != 1) return false;
+  }
+
+  // proper rotation, no mirror image
+  const int8_t *m = mounting;
+  int det = m[0] * (m[4] * m[8] - m[5] * m[7])
+            - m[1] * (m[3] * m[8] - m[5] * m[6])
+            + m[2] * (m[3] * m[7] - m[4] * m[6]);
+  return det == 1;
+}
+
+void presetMountingMatrix(bool isNano, int8_t mounting[MOUNTING_SIZE]) {
+  memcpy(mounting, isNano ? nanoMounting : devkitMounting, MOUNTING_SIZE);
+}
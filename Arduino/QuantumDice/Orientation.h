@@ -0,0 +1,23 @@
+#ifndef ORIENTATION_H_
+#define ORIENTATION_H_
+
+// Orientation classifier: maps the measured gravity vector to the face on top.
+// The sensor to dice frame rotation comes from the mounting matrix in DiceConfig, so a new board
+// revision only needs a config change. Pure code, no I/O, usable in a host test.
+#include <stdint.h>
+#include "DiceTypes.h"
+
+#define MOUNTING_SIZE 9  //3x3 matrix, row major, entries -1, 0 or 1
+
+struct Orientation {
+  MeasuredAxises axis;  // UNDEFINED when no axis is within LOWERBOUND..UPPERBOUND
+  UpSide upSide;        // NONE when axis is UNDEFINED
+  float margin;         // m/s2 between the strongest and the second strongest axis
+};
+
+// dice = M * sensor. Positive gravity along a dice axis selects face 0 of that axis, negative face 1
+Orientation classifyOrientation(const int8_t mounting[MOUNTING_SIZE], float xGravity, float yGravity, float zGravity);
+bool validMountingMatrix(const int8_t mounting[MOUNTING_SIZE]);  //signed permutation with determinant +1
+void presetMountingMatrix(bool isNano, int8_t mounting[MOUNTING_SIZE]);  //IMU on X+ side (NANO) or Y- side (DEVKIT)
+
+#endif /* ORIENTATION_H_ */
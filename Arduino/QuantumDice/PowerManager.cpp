@@ -0,0 +1,251 @@
+#define LOG_MODULE LOG_POWER
+#include "defines.h"
+#include "PowerManager.h"
+#include <esp_wifi.h>
+#include "ScreenStateDefs.h"
+#include "Screenfunctions.h"
+#include "handyHelpers.h"
+#include "BatteryMonitor.h"
+#include "FrequencyGovernor.h"
+#include "WarmSleep.h"
+
+PowerManager powerManager;
+
+static const char *subsystemName(uint8_t subsystem) {
+  switch ((PowerSubsystem)subsystem) {
+    case PowerSubsystem::CPU: return "cpu";
+    case PowerSubsystem::RADIO: return "radio";
+    case PowerSubsystem::DISPLAYS: return "displays";
+    case PowerSubsystem::IMU: return "imu";
+    default: return "?";
+  }
+}
+
+const char *powerTierName(PowerTier tier) {
+  switch (tier) {
+    case PowerTier::ACTIVE: return "ACTIVE";
+    case PowerTier::TOP_FACE: return "TOP_FACE";
+    case PowerTier::MODEM_SLEEP: return "MODEM_SLEEP";
+    case PowerTier::LOW_CPU: return "LOW_CPU";
+    case PowerTier::OFF: return "OFF";
+    default: return "?";
+  }
+}
+
+float PowerDraw::total() const {
+  float sum = 0.0f;
+  for (float current : mA) {
+    sum += current;
+  }
+  return sum;
+}
+
+// Entangled dice keep the radio and CPU at full speed: the sister's messages must arrive
+PowerTier selectPowerTier(State state, DiceStates diceState, unsigned long stillTime) {
+  if (stillTime >= currentConfig.deepSleepTimeout) {
+    return PowerTier::OFF;
+  }
+  if (state == State::IDLE || state == State::THROWING) {
+    return PowerTier::ACTIVE;
+  }
+  bool radioNeeded = state == State::INITENTANGLED_AB1 || state == State::INITENTANGLED_AB2
+                     || diceState == DiceStates::ENTANGLED_AB1 || diceState == DiceStates::ENTANGLED_AB2;
+  if (!radioNeeded && stillTime >= POWER_LOW_CPU_DELAY) {
+    return PowerTier::LOW_CPU;
+  }
+  if (!radioNeeded && stillTime >= POWER_MODEM_SLEEP_DELAY) {
+    return PowerTier::MODEM_SLEEP;
+  }
+  if (stillTime >= POWER_TOP_FACE_DELAY) {
+    return PowerTier::TOP_FACE;
+  }
+  return PowerTier::ACTIVE;
+}
+
+PowerDraw powerDraw(PowerTier tier, unsigned long asleepMs) {
+  PowerDraw draw = {};
+  if (tier == PowerTier::OFF) {  //warm sleep: IMU in low power, displays asleep. After it the regulator is off
+    if (!WARM_SLEEP_ENABLED || asleepMs >= WARM_SLEEP_MAX_TIME) {
+      return draw;
+    }
+    draw.mA[(uint8_t)PowerSubsystem::CPU] = POWER_SLEEP_MA;
+    draw.mA[(uint8_t)PowerSubsystem::DISPLAYS] = 6 * POWER_DISPLAY_SLEEP_MA;
+    draw.mA[(uint8_t)PowerSubsystem::IMU] = POWER_IMU_SLEEP_MA;
+    return draw;
+  }
+  draw.mA[(uint8_t)PowerSubsystem::CPU] = tier >= PowerTier::LOW_CPU ? POWER_CPU_LOW_MA : POWER_CPU_MA;
+  draw.mA[(uint8_t)PowerSubsystem::RADIO] = tier >= PowerTier::MODEM_SLEEP ? POWER_RADIO_SLEEP_MA : POWER_RADIO_MA;
+  draw.mA[(uint8_t)PowerSubsystem::DISPLAYS] = tier >= PowerTier::TOP_FACE ? POWER_DISPLAY_MA + 5 * POWER_DISPLAY_SLEEP_MA : 6 * POWER_DISPLAY_MA;
+  draw.mA[(uint8_t)PowerSubsystem::IMU] = POWER_IMU_MA;
+  return draw;
+}
+
+bool PowerManager::update(State state, bool moving) {
+  unsigned long now = millis();
+  if (moving || state != _state) {  //a new state redraws the faces, so it counts as motion
+    _moving = moving;
+    _lastMovementTime = now;
+    _state = state;
+  } else if (_moving) {
+    _lastMovementTime = now;
+    _moving = false;
+  }
+  account(state);
+
+  PowerTier tier = _moving ? PowerTier::ACTIVE : selectPowerTier(state, diceStateSelf, now - _lastMovementTime);
+  if (tier != _tier) {
+    apply(tier);
+  }
+  if (tier == PowerTier::OFF) {
+    _lastMovementTime = now;  //once, like the power cut
+    debugln("Time to sleep");
+    return true;
+  }
+  return false;
+}
+
+// Only the difference with the current tier is switched
+void PowerManager::apply(PowerTier tier) {
+  debug("power tier: ");
+  debugln(powerTierName(tier));
+  bool topFace = tier >= PowerTier::TOP_FACE && tier != PowerTier::OFF;
+  if (topFace && _topFace == 0xFF && upSideSelf >= UpSide::X0 && upSideSelf <= UpSide::Z1) {
+    _topFace = (uint8_t)upSideSelf - (uint8_t)UpSide::X0;  //UpSide X0..Z1 and screen selections X0..Z1 have the same order
+    for (uint8_t face = X0; face <= Z1; face++) {
+      if (face != _topFace) {
+        setScreensAsleep(face, true);
+      }
+    }
+  } else if (!topFace && _topFace != 0xFF) {
+    for (uint8_t face = X0; face <= Z1; face++) {
+      if (face != _topFace) {
+        setScreensAsleep(face, false);
+      }
+    }
+    _topFace = 0xFF;
+  }
+
+  bool modemSleep = tier >= PowerTier::MODEM_SLEEP && tier != PowerTier::OFF;
+  if (modemSleep != (_tier >= PowerTier::MODEM_SLEEP && _tier != PowerTier::OFF)) {
+    esp_wifi_set_ps(modemSleep ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM);
+  }
+
+  bool lowCpu = tier == PowerTier::LOW_CPU;
+  if (lowCpu != (_tier == PowerTier::LOW_CPU)) {
+    governor.setCeiling(lowCpu);
+  }
+  _tier = tier;
+}
+
+PowerDraw PowerManager::currentDraw() const {
+  PowerDraw draw = powerDraw(_tier);
+  if (_tier != PowerTier::OFF && !governor.isBoosted()) {
+    draw.mA[(uint8_t)PowerSubsystem::CPU] = POWER_CPU_LOW_MA;
+  }
+  if (_topFace == 0xFF && _tier >= PowerTier::TOP_FACE && _tier != PowerTier::OFF) {  //up side unknown, all faces stayed on
+    draw.mA[(uint8_t)PowerSubsystem::DISPLAYS] = 6 * POWER_DISPLAY_MA;
+  }
+  return draw;
+}
+
+void PowerManager::account(State state) {
+  unsigned long now = millis();
+  unsigned long elapsed = now - _lastAccountTime;
+  _lastAccountTime = now;
+  if (elapsed > 1000) {  //first call or after a pause (self test, benchmarks): not representative
+    return;
+  }
+  PowerDraw draw = currentDraw();
+  for (uint8_t i = 0; i < (uint8_t)PowerSubsystem::COUNT; i++) {
+    _subsystemCharge[i] += draw.mA[i] * elapsed;
+  }
+  _stateCharge[(int)state] += draw.total() * elapsed;
+  _tierTime[(uint8_t)_tier] += elapsed;
+  _accountedTime += elapsed;
+}
+
+void PowerManager::clear() {
+  memset(_stateCharge, 0, sizeof(_stateCharge));
+  memset(_subsystemCharge, 0, sizeof(_subsystemCharge));
+  memset(_tierTime, 0, sizeof(_tierTime));
+  _accountedTime = 0;
+}
+
+static const double MA_MS_PER_MAH = 3600000.0;
+
+void PowerManager::print(Print &out) const {
+  out.printf("tier %s, still %lu ms\n", powerTierName(_tier), _moving ? 0UL : millis() - _lastMovementTime);
+  batteryMonitor.print(out);
+  governor.print(out);
+  if (_accountedTime == 0) {
+    return;
+  }
+  double total = 0.0;
+  for (uint8_t i = 0; i < (uint8_t)PowerSubsystem::COUNT; i++) {
+    out.printf("%-22s %.3f mAh\n", subsystemName(i), _subsystemCharge[i] / MA_MS_PER_MAH);
+    total += _subsystemCharge[i];
+  }
+  for (int i = 0; i < (int)State::COUNT; i++) {
+    if (_stateCharge[i] > 0.0) {
+      out.printf("%-22s %.3f mAh\n", stateName((State)i), _stateCharge[i] / MA_MS_PER_MAH);
+    }
+  }
+  for (uint8_t i = 0; i < (uint8_t)PowerTier::COUNT; i++) {
+    out.printf("%-22s %lu s\n", powerTierName((PowerTier)i), _tierTime[i] / 1000);
+  }
+  double averageMa = total / _accountedTime;
+  out.printf("average %.1f mA over %lu s, projected battery life %.1f h\n", averageMa, _accountedTime / 1000,
+             BATTERY_CAPACITY_MAH / averageMa);
+}
+
+#if DEV_TOOLS == 1
+// Scripted school day: lessons with throws at a fixed interval, breaks and storage in between
+struct DaySegment {
+  uint16_t minutes;
+  uint16_t throwInterval;  //s between throws, 0 no throws
+  bool entangled;
+};
+
+static const DaySegment schoolDay[] = {
+  { 45, 30, false },  //lesson: single throws
+  { 15, 0, false },   //break, die on the table
+  { 45, 60, true },   //lesson: entangled pairs
+  { 105, 0, false },  //in the box
+  { 45, 20, false },  //lesson
+  { 705, 0, false },  //rest of the day and the night
+};
+
+#define SIM_THROW_TIME 2  //s THROWING per throw
+
+void simulatePowerDay(Print &out) {
+  double charge[(uint8_t)PowerTier::COUNT] = {};  //mA s
+  unsigned long tierTime[(uint8_t)PowerTier::COUNT] = {};
+  unsigned long seconds = 0;
+  unsigned long stillTime = 0;  //ms
+  for (const DaySegment &segment : schoolDay) {
+    for (unsigned long second = 0; second < segment.minutes * 60UL; second++, seconds++) {
+      State state = State::WAITFORTHROW;
+      bool moving = false;
+      if (segment.throwInterval && second % segment.throwInterval < SIM_THROW_TIME) {
+        state = State::THROWING;
+        moving = true;
+      }
+      DiceStates diceState = segment.entangled ? DiceStates::ENTANGLED_AB1 : DiceStates::SINGLE;
+      stillTime = moving ? 0 : stillTime + 1000;
+      PowerTier tier = selectPowerTier(state, diceState, stillTime);
+      unsigned long asleepMs = tier == PowerTier::OFF ? stillTime - currentConfig.deepSleepTimeout : 0;
+      charge[(uint8_t)tier] += powerDraw(tier, asleepMs).total();
+      tierTime[(uint8_t)tier]++;
+    }
+  }
+
+  double total = 0.0;
+  for (uint8_t i = 0; i < (uint8_t)PowerTier::COUNT; i++) {
+    out.printf("%-22s %5lu s %8.2f mAh\n", powerTierName((PowerTier)i), tierTime[i], charge[i] / 3600.0);
+    total += charge[i];
+  }
+  double dayMah = total / 3600.0 * 86400.0 / seconds;
+  out.printf("day %.1f mAh, battery lasts %.1f days (deepSleepTimeout %lu ms, warm sleep %d)\n", dayMah,
+             BATTERY_CAPACITY_MAH / dayMah, (unsigned long)currentConfig.deepSleepTimeout, WARM_SLEEP_ENABLED);
+}
+#endif
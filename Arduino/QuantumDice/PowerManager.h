@@ -0,0 +1,85 @@
+#ifndef POWERMANAGER_H_
+#define POWERMANAGER_H_
+
+// Tiered power manager. The tier follows from the state and the time since the last motion; each tier
+// adds a saving to the one before it. An energy model with per subsystem currents accounts mAh per state
+// and per subsystem and projects the battery life. Printed by the "power" serial command, "power sim"
+// (DEV_TOOLS) runs the same tier selection and model over a scripted school day.
+// The currents are estimates for the model, replace them with measured values of a die.
+#include <Arduino.h>
+#include "StateMachine.h"
+
+#define POWER_TOP_FACE_DELAY 15000    //ms still: displays asleep except the top face
+#define POWER_MODEM_SLEEP_DELAY 30000 //ms still: Wi-Fi maximum modem sleep, not while entangled
+#define POWER_LOW_CPU_DELAY 60000     //ms still: no full clock bursts (FrequencyGovernor.h), not while entangled
+#define POWER_LOW_CPU_MHZ 80          //lowest frequency that keeps Wi-Fi running
+
+#define POWER_CPU_MA 45.0f            //ESP32-S3 at 240 MHz, RF off
+#define POWER_CPU_LOW_MA 22.0f        //at POWER_LOW_CPU_MHZ, the governor's low frequency
+#define POWER_RADIO_MA 30.0f          //Wi-Fi minimum modem sleep (driver default), average
+#define POWER_RADIO_SLEEP_MA 6.0f     //Wi-Fi maximum modem sleep, average
+#define POWER_DISPLAY_MA 12.0f        //per face
+#define POWER_DISPLAY_SLEEP_MA 5.0f   //per face in sleep mode
+#define POWER_IMU_MA 12.3f            //BNO055 in NDOF fusion mode
+#define POWER_IMU_SLEEP_MA 0.4f       //BNO055 accelerometer only in low power mode, during warm sleep
+#define POWER_SLEEP_MA 0.1f           //ESP32-S3 in deep sleep, RTC memory kept
+#define BATTERY_CAPACITY_MAH 1000     //usable capacity of the cell
+
+enum class PowerTier : uint8_t {
+  ACTIVE,
+  TOP_FACE,     //other faces asleep
+  MODEM_SLEEP,  //+ radio in maximum modem sleep
+  LOW_CPU,      //+ CPU kept at the low frequency
+  OFF,          //warm sleep or power cut (WarmSleep.h)
+  COUNT
+};
+
+enum class PowerSubsystem : uint8_t {
+  CPU,
+  RADIO,
+  DISPLAYS,
+  IMU,
+  COUNT
+};
+
+struct PowerDraw {
+  float mA[(uint8_t)PowerSubsystem::COUNT];
+
+  float total() const;
+};
+
+PowerTier selectPowerTier(State state, DiceStates diceState, unsigned long stillTime);
+PowerDraw powerDraw(PowerTier tier, unsigned long asleepMs = 0);  //asleepMs: time in OFF, the power is cut after the warm sleep
+const char *powerTierName(PowerTier tier);
+
+class PowerManager {
+public:
+  bool update(State state, bool moving);  //once per loop, true when the OFF tier is reached
+  void print(Print &out) const;
+  void clear();
+  PowerDraw currentDraw() const;  //estimate for the current tier
+
+private:
+  void apply(PowerTier tier);
+  void account(State state);
+
+  PowerTier _tier = PowerTier::ACTIVE;
+  State _state = State::IDLE;
+  uint8_t _topFace = 0xFF;    //screen selection left on in TOP_FACE, 0xFF all
+  bool _moving = true;
+  unsigned long _lastMovementTime = 0;
+  unsigned long _lastAccountTime = 0;
+
+  double _stateCharge[(int)State::COUNT];                   //mA ms
+  double _subsystemCharge[(uint8_t)PowerSubsystem::COUNT];  //mA ms
+  unsigned long _tierTime[(uint8_t)PowerTier::COUNT];       //ms
+  unsigned long _accountedTime = 0;                         //ms
+};
+
+#if DEV_TOOLS == 1
+void simulatePowerDay(Print &out);
+#endif
+
+extern PowerManager powerManager;
+
+#endif /* POWERMANAGER_H_ */
@@ -8,31 +8,54 @@
 #include "ImageLibrary/ImageLibrary.h"
 #include "ScreenStateDefs.h"
 #include "IMUhelpers.h"
+#include "SyntheticIMU.h"
 #include "Screenfunctions.h"
 #include "handyHelpers.h"
 #include "StateMachine.h"
+#include "SerialCommands.h"
+#include "SelfTest.h"
+#include "BootSequencer.h"
+#include "WarmSleep.h"
+#include "BatteryMonitor.h"
+#include "FrequencyGovernor.h"
+#include "MemoryBudget.h"
+#include "DeferredLog.h"
+#include <WiFi.h>
 
 StateMachine stateMachine;
 
 #define UPDATE_INTERVAL 50  //loop functions
 unsigned long previousMillisWatchDog = 0;
 
-void setup() {
-  // Make sure power switch keeps on - do this FIRST before anything else
-  pinMode(REGULATOR_PIN, OUTPUT);
-  digitalWrite(REGULATOR_PIN, LOW);
-  
-  // Initialize serial for debugging
-  initSerial(); // delay(1000) included
-  
+// Boot tasks, run on core 0 while setup() initializes the displays
+static void bootImu(void *parameter) {
+  IMUSensor *imuSensor = (IMUSensor *)parameter;
+  imuSensor->init();  // This will load BNO055 calibration from EEPROM
+  imuSensor->update();
+  imuSensor->reset();
+}
+
+static void resumeImu(void *parameter) {
+  IMUSensor *imuSensor = (IMUSensor *)parameter;
+  imuSensor->resume();  // BNO055 kept running with its calibration
+  imuSensor->update();
+  imuSensor->reset();
+}
+
+static void bootRadio(void *parameter) {
+  WiFi.mode(WIFI_STA);  // Starting the Wi-Fi driver is the slow part of the ESP-NOW init
+}
+
+// Cold boot: configuration from EEPROM
+static void loadConfig() {
   // Initialize EEPROM ONCE for both config and IMU calibration
   initEEPROM();
   
   // Load dice configuration from EEPROM
   // This MUST be done early because it initializes hwPins which are needed for displays
   if (!loadConfigFromEEPROM()) {
-    Serial.println("FATAL ERROR: Cannot load configuration!");
-    Serial.println("Please flash configuration using the setup sketch.");
+    consoleOut.println("FATAL ERROR: Cannot load configuration!");
+    consoleOut.println("Please flash configuration using the setup sketch.");
     // Halt execution - can't proceed without valid configuration
     while(1) {
       delay(1000);
@@ -40,49 +63,110 @@ void setup() {
   }
   
   // Print version and configuration info
-  Serial.println("\n" __FILE__ " " __DATE__ " " __TIME__);
-  Serial.print("FW: ");
-  Serial.print(VERSION);
-  Serial.print(" - Dice ID: ");
-  Serial.println(currentConfig.diceId);  // Use diceId from config
-  Serial.print("Board type: ");
-  Serial.println(currentConfig.isNano ? "NANO" : "DEVKIT");  // Use config instead of defines
+  consoleOut.println("\n" __FILE__ " " __DATE__ " " __TIME__);
+  consoleOut.print("FW: ");
+  consoleOut.print(VERSION);
+  consoleOut.print(" - Dice ID: ");
+  consoleOut.println(currentConfig.diceId);  // Use diceId from config
+  consoleOut.print("Board type: ");
+  consoleOut.println(currentConfig.isNano ? "NANO" : "DEVKIT");  // Use config instead of defines
+}
+
+void setup() {
+  // Make sure power switch keeps on - do this FIRST before anything else
+  pinMode(REGULATOR_PIN, OUTPUT);
+  digitalWrite(REGULATOR_PIN, LOW);
   
-  // Initialize displays - now uses hwPins from loaded configuration
-  initDisplays();
+  // After a warm sleep: back to sleep without motion, otherwise resume without config, calibration and logo
+  bool warm = warmResume();
   
-  // Show startup logo during setup
-  displayQLab(ALL);
+  // Initialize serial for debugging
+  bootBegin(BootStage::SERIAL_PORT);
+  initSerial(!warm);  // waits SERIAL_WAIT_TIMEOUT at most for a monitor
+  bootEnd(BootStage::SERIAL_PORT);
+  
+  bootBegin(BootStage::CONFIG);
+  if (warm) {
+    consoleOut.printf("Warm resume %u of %s after %lu ms asleep\n", warmState.resumes, currentConfig.diceId,
+                      (unsigned long)warmState.asleepMs);
+  } else {
+    loadConfig();
+  }
+  batteryMonitor.update();  // first reading for the state handlers, needs hwPins
+  bootEnd(BootStage::CONFIG);
   
-  // Initialize IMU sensor
+  // Start the IMU (I2C) and the radio in parallel with the displays (SPI)
   IMUSensor *imuSensor;
+#if SYNTHETIC_IMU == 1
+  imuSensor = new SyntheticIMUSensor();
+#else
   imuSensor = new BNO055IMUSensor();
-  imuSensor->init();  // This will load BNO055 calibration from EEPROM
-  imuSensor->update();
-  imuSensor->reset();
+#endif
+  bootStartTask(BootStage::IMU, warm ? resumeImu : bootImu, imuSensor);
+  bootStartTask(BootStage::RADIO, bootRadio, nullptr);
   
-  // Set IMU sensor in state machine
-  stateMachine.setImuSensor(imuSensor);
+  // Initialize displays - now uses hwPins from loaded configuration
+  bootBegin(BootStage::DISPLAYS);
+  if (warm) {
+    resumeDisplays();  // frame memory kept, no logo
+  } else {
+    initDisplays();
+  
+    // Show startup logo during setup
+    displayQLab(ALL);
+  }
+  bootEnd(BootStage::DISPLAYS);
   
   // Initialize button
   initButton();
   
-  // Initialize random number generators
+  // Initialize random number generators, the ATECC shares the I2C bus with the IMU
+  bootWait(BootStage::IMU);
+  bootBegin(BootStage::RANDOM);
   initRandomGenerators();
+  if (warm) {
+    restoreRandomPool();
+  }
+  bootEnd(BootStage::RANDOM);
+
+  // Sampler after atecc.begin(), which uses the shared I2C bus before the I2C scheduler exists
+  imuSensor->getRecorder().begin();  // flash writer for the throw snapshots
+  imuSensor->startSampler(IMU_SAMPLE_INTERVAL);  // Fixed rate sampling, independent of the render load
+  
+  // Set IMU sensor in state machine
+  stateMachine.setImuSensor(imuSensor);
+  initSerialCommands(imuSensor);
   
   // Initialize the state machine - this sets up ESP-NOW with config MACs
-  stateMachine.begin();
+  bootWait(BootStage::RADIO);
+  bootBegin(BootStage::STATE_MACHINE);
+  if (warm) {
+    stateMachine.resume(warmState.dice);
+  } else {
+    stateMachine.begin();
+  }
+  bootEnd(BootStage::STATE_MACHINE);
+  bootReady(warm);
+  governor.begin();  // boot at the full clock, from here on only render bursts and measurement
   
-  Serial.println("Setup complete!");
-  Serial.println("==================================\n");
+  printBootTimes(consoleOut);
+  consoleOut.println("Setup complete!");
+  consoleOut.println("==================================\n");
 }
 
 void loop() {
   static unsigned long lastUpdateTime = 0;
   unsigned long currentTime = millis();
   if (currentTime - lastUpdateTime >= UPDATE_INTERVAL) {
+    allocationCheckBegin();
     button.loop();
     stateMachine.update();
+    allocationCheckEnd(stateMachine.getCurrentState());
+    handleSerialCommands();
+    if (selfTestRequested) {
+      selfTestRequested = false;
+      runSelfTest(consoleOut, stateMachine);
+    }
     //   refreshScreens();
     //   sendWatchDog(); //sendWatchDog removed. Is called at every onEntry function after the states are set. More efficient.
   }
@@ -0,0 +1,51 @@
+#ifndef RINGBUFFER_H_
+#define RINGBUFFER_H_
+
+#include <atomic>
+#include <stddef.h>
+
+// Fixed size ring buffer for one producer and one consumer, e.g. a sampler task and the main loop.
+// Lock free: push() and pop() may run on different cores. When full, new items are dropped and counted.
+// One slot stays empty to tell full from empty, so it holds N - 1 items.
+template <typename T, size_t N>
+class RingBuffer
+{
+private:
+  T data[N];
+  std::atomic<size_t> head;  //next item to pop, only written by the consumer
+  std::atomic<size_t> tail;  //next free slot, only written by the producer
+  std::atomic<unsigned long> dropped;
+
+public:
+  RingBuffer() : head(0), tail(0), dropped(0) {}
+
+  bool push(const T& item)
+  {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t next = (t + 1) % N;
+    if (next == head.load(std::memory_order_acquire)) {
+      dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    data[t] = item;
+    tail.store(next, std::memory_order_release);
+    return true;
+  }
+
+  bool pop(T* item)
+  {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    *item = data[h];
+    head.store((h + 1) % N, std::memory_order_release);
+    return true;
+  }
+
+  bool isEmpty() const { return head.load() == tail.load(); }
+  size_t size() const { return (tail.load() + N - head.load()) % N; }
+  unsigned long droppedCount() const { return dropped.load(); }
+};
+
+#endif /* RINGBUFFER_H_ */
@@ -1,3 +1,4 @@
+#define LOG_MODULE LOG_SCREEN
 #include "Arduino.h"
 #include "defines.h"
 #include "IMUhelpers.h"
@@ -6,6 +7,10 @@
 #include "ScreenDeterminator.h"  //TruthTable to select screens from various states
 //#include "StateMachine.h"
 #include "ScreenStateDefs.h"
+#include "DiceOutcome.h"
+#include "Orientation.h"
+#include "TracePoints.h"
+#include "FrequencyGovernor.h"
 
 State stateSelf, stateSister;  //state is used for TruthTable. Is copy of currenState.
 DiceStates diceStateSelf, prevDiceStateSelf, diceStateSister;
@@ -16,91 +21,12 @@ ScreenStates x0ReqScreenState, x1ReqScreenState, y0ReqScreenState, y1ReqScreenSt
 
 BlinkStates blinkState;
 
-void printDiceStateName(const char *objectName, DiceStates diceState) {
-  static DiceStates previousDiceState = DiceStates::NONE;  // Local static variable to retain its value between function calls
-                                                           /*
-DiceStates::SINGLE
-DiceStates::ENTANGLED
-DiceStates::MEASURED
-DiceStates::ALL
-DiceStates::NONE
-DiceStates::CLASSIC
-*/
+// Only when it changed: called on every update
+void printDiceStateName(DiceStates diceState) {
+  static DiceStates previousDiceState = DiceStates::NONE;
   if (diceState != previousDiceState) {
-    debug(objectName);
-    debug(": ");
-    switch (diceState) {
-      case DiceStates::SINGLE:
-        debugln("DiceStates::SINGLE");
-        break;
-      case DiceStates::ENTANGLED_AB1:
-        debugln("DiceStates::ENTANGLED_AB1");
-        break;
-      case DiceStates::ENTANGLED_AB2:
-        debugln("DiceStates::ENTANGLED_AB2");
-        break;
-      case DiceStates::UN_ENTANGLED_AB1:
-        debugln("DiceStates::UN_ENTANGLED_AB1");
-        break;
-      case DiceStates::UN_ENTANGLED_AB2:
-        debugln("DiceStates::UN_ENTANGLED_AB2");
-        break;
-      case DiceStates::MEASURED:
-        debugln("DiceStates::MEASURED");
-        break;
-      case DiceStates::MEASURED_AFTER_ENT:
-        debugln("DiceStates::MEASURED_AFTER_ENT");
-        break;
-      case DiceStates::ALL:
-        debugln("DiceStates::ALL");
-        break;
-      case DiceStates::NONE:
-        debugln("DiceStates::NONE");
-        break;
-      case DiceStates::CLASSIC:
-        debugln("DiceStates::CLASSIC");
-        break;
-    }
-    previousDiceState = diceState;  // Update previousState
-  }
-}
-
-void printDiceStateName2(const char *objectName, DiceStates diceState) {
-  static DiceStates previousDiceState = DiceStates::NONE;  // Local static variable to retain its value between function calls
-
-  debug(objectName);
-  debug(": ");
-  switch (diceState) {
-    case DiceStates::SINGLE:
-      debugln("DiceStates::SINGLE");
-      break;
-    case DiceStates::ENTANGLED_AB1:
-      debugln("DiceStates::ENTANGLED_AB1");
-      break;
-    case DiceStates::ENTANGLED_AB2:
-      debugln("DiceStates::ENTANGLED_AB2");
-      break;
-    case DiceStates::UN_ENTANGLED_AB1:
-      debugln("DiceStates::UN_ENTANGLED_AB1");
-      break;
-    case DiceStates::UN_ENTANGLED_AB2:
-      debugln("DiceStates::UN_ENTANGLED_AB2");
-      break;
-    case DiceStates::MEASURED:
-      debugln("DiceStates::MEASURED");
-      break;
-    case DiceStates::MEASURED_AFTER_ENT:
-      debugln("DiceStates::MEASURED_AFTER_ENT");
-      break;
-    case DiceStates::ALL:
-      debugln("DiceStates::ALL");
-      break;
-    case DiceStates::NONE:
-      debugln("DiceStates::NONE");
-      break;
-    case DiceStates::CLASSIC:
-      debugln("DiceStates::CLASSIC");
-      break;
+    debugRecord(DICE_STATE, diceState);
+    previousDiceState = diceState;
   }
 }
 
@@ -109,6 +35,7 @@ bool findValues(State state, DiceStates diceState, DiceNumbers diceNumber, UpSid
   //                 ScreenStates &x0ScreenState, ScreenStates &x1ScreenState, ScreenStates &y0ScreenState, ScreenStates &y1ScreenState, ScreenStates &z0ScreenState, ScreenStates &z1ScreenState) {
   // bool findValues(State state, UpSide upSide, UpSide upSideSister,
   //                 ScreenStates &x0ScreenState, ScreenStates &x1ScreenState, ScreenStates &y0ScreenState, ScreenStates &y1ScreenState, ScreenStates &z0ScreenState, ScreenStates &z1ScreenState) {
+  TRACE_SCOPE(FIND_VALUES, 0);
   for (const auto &entry : truthTable) {
     if (entry.state == stateSelf && (entry.diceState == diceStateSelf || entry.diceState == DiceStates::ANY) && (entry.diceNumber == diceNumberSelf || entry.diceNumber == DiceNumbers::ANY) && (entry.upSide == upSideSelf || entry.upSide == UpSide::ANY)) {
       x0ScreenState = entry.x0ScreenState;
@@ -123,15 +50,16 @@ bool findValues(State state, DiceStates diceState, DiceNumbers diceNumber, UpSid
   return false;  // No match found
 }
 
-void callFunction(ScreenStates result, screenselections screens) {
+void callFunction(ScreenStates result, uint8_t screens) {
+  FrequencyBoost boost(true);
+  TRACE_SCOPE(RENDER, result);
+  debugRecord(RENDER, result, screens);
   switch (result) {
     case ScreenStates::GODDICE:
       displayEinstein(screens);
-      Serial.println("GODDICE function called");
       break;
     case ScreenStates::WELCOME:
       welcomeInfo(screens);
-      Serial.println("WELCOME function called");
       break;
     case ScreenStates::N1:
       displayN1(screens);
@@ -171,96 +99,122 @@ void callFunction(ScreenStates result, screenselections screens) {
       break;
     case ScreenStates::LOWBATTERY:
       displayLowBattery(screens);
-      Serial.println("LOWBATTERY function called");
       break;
     case ScreenStates::BLANC:
       blankScreen(screens);
-      Serial.println("BLANC function called");
       break;
     case ScreenStates::DIAGNOSE:
-      voltageIndicator(screens);
-      Serial.println("DIAGNOSE function called");
+      voltageIndicator(screens, true);
       break;
     case ScreenStates::XO:
       displayCrossCircle(screens);
-      Serial.println("XO function called");
       break;
     case ScreenStates::XOENTANG:
       displayEntangled(screens);
-      Serial.println("XOENTANG function called");
       break;
     case ScreenStates::RESET:
       displayNewDie(screens);
-      Serial.println("RESET function called");
       break;
     case ScreenStates::X_STATE:
       displayCross(screens);
-      Serial.println("X_STATE function called");
       break;
     case ScreenStates::O_STATE:
       displayCircle(screens);
-      Serial.println("O_STATE function called");
       break;
     case ScreenStates::QLAB_LOGO:
       displayQLab(screens);
-      Serial.println("QLAB_LOGO function called");
       break;
     case ScreenStates::UT_LOGO:
       displayUTlogo(screens);
-      Serial.println("UT_LOGO function called");
       break;
     case ScreenStates::QRCODE:
       displayQRcode(screens);
-      Serial.println("QRCode function called");
       break;
     default:
-      Serial.println("No specific function for state");
+      debugln("No specific function for state");
   }
 }
-void checkAndCallFunctions(ScreenStates x0, ScreenStates x1, ScreenStates y0, ScreenStates y1, ScreenStates z0, ScreenStates z1) {
-  static ScreenStates prevX0 = ScreenStates::BLANC;
-  static ScreenStates prevY0 = ScreenStates::BLANC;
-  static ScreenStates prevZ0 = ScreenStates::BLANC;
-  static ScreenStates prevX1 = ScreenStates::BLANC;
-  static ScreenStates prevY1 = ScreenStates::BLANC;
-  static ScreenStates prevZ1 = ScreenStates::BLANC;
-
-  if (x0 != prevX0) {
-    //debug("X0:");
-    callFunction(x0, X0);
-    prevX0 = x0;
+const char *screenStateName(ScreenStates screenState) {
+  switch (screenState) {
+    case ScreenStates::GODDICE: return "GODDICE";
+    case ScreenStates::WELCOME: return "WELCOME";
+    case ScreenStates::N1: return "N1";
+    case ScreenStates::N2: return "N2";
+    case ScreenStates::N3: return "N3";
+    case ScreenStates::N4: return "N4";
+    case ScreenStates::N5: return "N5";
+    case ScreenStates::N6: return "N6";
+    case ScreenStates::MIX1TO6: return "MIX1TO6";
+    case ScreenStates::MIX1TO6_ENTAB1: return "MIX1TO6_ENTAB1";
+    case ScreenStates::MIX1TO6_ENTAB2: return "MIX1TO6_ENTAB2";
+    case ScreenStates::LOWBATTERY: return "LOWBATTERY";
+    case ScreenStates::BLANC: return "BLANC";
+    case ScreenStates::XO: return "XO";
+    case ScreenStates::XOENTANG: return "XOENTANG";
+    case ScreenStates::DIAGNOSE: return "DIAGNOSE";
+    case ScreenStates::RESET: return "RESET";
+    case ScreenStates::X_STATE: return "X_STATE";
+    case ScreenStates::O_STATE: return "O_STATE";
+    case ScreenStates::QLAB_LOGO: return "QLAB_LOGO";
+    case ScreenStates::QRCODE: return "QRCODE";
+    case ScreenStates::UT_LOGO: return "UT_LOGO";
+    default: return "?";
   }
-  if (y0 != prevY0) {
-    //debug("Y0:");
-    callFunction(y0, Y0);
-    prevY0 = y0;
-  }
-  if (z0 != prevZ0) {
-    //debug("Z0:");
-    callFunction(z0, Z0);
-    prevZ0 = z0;
+}
+
+// Screen states currently shown per face, indexed by screenselections X0..Z1; only changed faces are
+// redrawn. In RTC memory like the frame memory of the displays, which survives a warm sleep
+static RTC_DATA_ATTR ScreenStates prevScreenStates[FACES] = {
+  ScreenStates::BLANC, ScreenStates::BLANC, ScreenStates::BLANC,
+  ScreenStates::BLANC, ScreenStates::BLANC, ScreenStates::BLANC
+};
+
+void invalidateScreens() {
+  for (uint8_t face = 0; face < FACES; face++) {
+    prevScreenStates[face] = ScreenStates::COUNT;
   }
-  if (x1 != prevX1) {
-    //debug("X1:");
-    callFunction(x1, X1);
-    prevX1 = x1;
+}
+
+// The up face first, then the four side faces, the bottom face last. Without a measured side the
+// fixed order X0, Y0, Z0, X1, Y1, Z1
+void renderOrder(UpSide upSide, uint8_t order[FACES]) {
+  static const uint8_t fixedOrder[FACES] = { X0, Y0, Z0, X1, Y1, Z1 };
+  if (upSide < UpSide::X0 || upSide > UpSide::Z1) {
+    memcpy(order, fixedOrder, FACES);
+    return;
   }
-  if (y1 != prevY1) {
-    //debug("Y1:");
-    callFunction(y1, Y1);
-    prevY1 = y1;
+  uint8_t top = (uint8_t)upSide - (uint8_t)UpSide::X0;  //same order as screenselections
+  uint8_t bottom = top ^ 1;                              //X0/X1, Y0/Y1, Z0/Z1
+  uint8_t count = 0;
+  order[count++] = top;
+  for (uint8_t face : fixedOrder) {
+    if (face != top && face != bottom) {
+      order[count++] = face;
+    }
   }
-  if (z1 != prevZ1) {
-    //debug("Z1:");
-    callFunction(z1, Z1);
-    prevZ1 = z1;
+  order[count] = bottom;
+}
+
+void checkAndCallFunctions(ScreenStates x0, ScreenStates x1, ScreenStates y0, ScreenStates y1, ScreenStates z0, ScreenStates z1, UpSide upSide) {
+  const ScreenStates requested[FACES] = { x0, x1, y0, y1, z0, z1 };
+  uint8_t order[FACES];
+  renderOrder(upSide, order);
+  for (uint8_t i = 0; i < FACES; i++) {
+    uint8_t face = order[i];
+    if (requested[face] != prevScreenStates[face]) {
+      callFunction(requested[face], face);
+      prevScreenStates[face] = requested[face];
+    }
+    if (i == 0 && upSide >= UpSide::X0 && upSide <= UpSide::Z1) {
+      TRACE_INSTANT(TOP_FACE, face);  //landing to readable result, see enterINITMEASURED
+    }
   }
 }
 
 void refreshScreens() {
   // set screens, depending of states
   if (findValues(stateSelf, diceStateSelf, diceNumberSelf, upSideSelf, x0ReqScreenState, x1ReqScreenState, y0ReqScreenState, y1ReqScreenState, z0ReqScreenState, z1ReqScreenState)) {
-    checkAndCallFunctions(x0ReqScreenState, x1ReqScreenState, y0ReqScreenState, y1ReqScreenState, z0ReqScreenState, z1ReqScreenState);
+    checkAndCallFunctions(x0ReqScreenState, x1ReqScreenState, y0ReqScreenState, y1ReqScreenState, z0ReqScreenState, z1ReqScreenState, upSideSelf);
   } else {
     debugln("no match found");
     // No match found, handle accordingly
@@ -295,37 +249,15 @@ DiceNumbers selectOneToSix() {
 }
 DiceNumbers selectOppositeOneToSix(DiceNumbers diceNumberTop) {
   debugln("select opposite number");
-  switch (diceNumberTop) {  //select the opposite value
-    case DiceNumbers::ONE:
-      return DiceNumbers::SIX;
-      break;
-    case DiceNumbers::TWO:
-      return DiceNumbers::FIVE;
-      break;
-    case DiceNumbers::THREE:
-      return DiceNumbers::FOUR;
-      break;
-    case DiceNumbers::FOUR:
-      return DiceNumbers::THREE;
-      break;
-    case DiceNumbers::FIVE:
-      return DiceNumbers::TWO;
-      break;
-    case DiceNumbers::SIX:
-      return DiceNumbers::ONE;
-      break;
-  }
+  return oppositeDiceNumber(diceNumberTop);  //select the opposite value
 }
 MeasuredAxises getAxis(IMUSensor *imuSensor) {
   //detection algoritmn: which side up?
-  if (withinBounds(abs(imuSensor->getXGravity()), LOWERBOUND, UPPERBOUND)) {
-    return MeasuredAxises::ZAXIS;
-  } else if (withinBounds(abs(imuSensor->getYGravity()), LOWERBOUND, UPPERBOUND)) {
-    return MeasuredAxises::YAXIS;
-  } else if (withinBounds(abs(imuSensor->getZGravity()), LOWERBOUND, UPPERBOUND)) {
-    return MeasuredAxises::XAXIS;
-  } else {
+  float xGravity, yGravity, zGravity;
+  imuSensor->getRestGravity(xGravity, yGravity, zGravity);
+  MeasuredAxises axis = classifyOrientation(currentConfig.mounting, xGravity, yGravity, zGravity).axis;
+  if (axis == MeasuredAxises::UNDEFINED) {
     debugln("no clear axis");
-    return MeasuredAxises::UNDEFINED;
   }
+  return axis;
 }
\ No newline at end of file
@@ -3,62 +3,14 @@
 #define SCREENSTATEDEFS_H_
 
 #include "Statemachine.h"  // Ensure this is included
+#include "DiceTypes.h"
 //truth table at the end of this file
 
 extern State stateSelf, stateSister;  //use of the StateMachine inputs
 
-enum class DiceStates : uint8_t {
-  SINGLE,
-  ENTANGLED_AB1,
-  ENTANGLED_AB2,
-  UN_ENTANGLED_AB1,
-  UN_ENTANGLED_AB2,
-  MEASURED,
-  MEASURED_AFTER_ENT,
-  ALL,
-  NONE,
-  CLASSIC,
-  ANY,
-  NA
-};
 extern DiceStates diceStateSelf, prevDiceStateSelf, diceStateSister;
-
-enum class DiceNumbers : uint8_t {
-  NONE,
-  ONE,
-  TWO,
-  THREE,
-  FOUR,
-  FIVE,
-  SIX,
-  CROSS,
-  CIRCLE,
-  ANY,
-  NA
-};
 extern DiceNumbers diceNumberSelf, diceNumberSister;
-
-enum class MeasuredAxises : uint8_t {
-  UNDEFINED,
-  XAXIS,
-  YAXIS,
-  ZAXIS,
-  ALL,
-  NA  //not applicable
-};
 extern MeasuredAxises measureAxisSelf, prevMeasureAxisSelf, measureAxisSister;
-
-enum class UpSide : uint8_t {
-  NONE,
-  X0,
-  X1,
-  Y0,
-  Y1,
-  Z0,
-  Z1,
-  ANY,
-  NA
-};
 extern UpSide upSideSelf, prevUpSideSelf, upSideSister;
 
 enum class ScreenStates : uint8_t {
@@ -83,7 +35,8 @@ enum class ScreenStates : uint8_t {
   O_STATE,
   QLAB_LOGO,
   QRCODE,
-  UT_LOGO
+  UT_LOGO,
+  COUNT  //number of screen states, not a screen state
 };
 extern ScreenStates x0ReqScreenState, x1ReqScreenState, y0ReqScreenState, y1ReqScreenState, z0ReqScreenState, z1ReqScreenState;  //actual screenstates of x, y and z
 
@@ -116,15 +69,19 @@ bool findValues(State state, DiceStates diceState, DiceNumbers diceNumber, UpSid
 
 //const char *toString(ScreenStates value);
 
-void callFunction(ScreenStates result);
+void callFunction(ScreenStates result, uint8_t screens);
+
+#define FACES 6  //X0..Z1 in screenselections
 
-void checkAndCallFunctions(ScreenStates x0, ScreenStates x1, ScreenStates y0, ScreenStates y1, ScreenStates z0, ScreenStates z1);
+void renderOrder(UpSide upSide, uint8_t order[FACES]);  //faces by priority: up, sides, bottom
+void checkAndCallFunctions(ScreenStates x0, ScreenStates x1, ScreenStates y0, ScreenStates y1, ScreenStates z0, ScreenStates z1, UpSide upSide);
 void refreshScreens();
+void invalidateScreens();  //next refreshScreens() redraws every face
+const char *screenStateName(ScreenStates screenState);
 DiceNumbers selectOneToSix();
 DiceNumbers selectOppositeOneToSix(DiceNumbers diceNumberTop);
-void printDiceStateName(const char *objectName, DiceStates diceState);
-void printDiceStateName2(const char *objectName, DiceStates diceState);
-MeasuredAxises getAxis();
+void printDiceStateName(DiceStates diceState);
+MeasuredAxises getAxis(IMUSensor *imuSensor);
 
 
 #endif /* SCREENSTATEDEFS_H_ */
\ No newline at end of file
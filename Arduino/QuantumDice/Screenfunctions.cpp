@@ -1,3 +1,4 @@
+#define LOG_MODULE LOG_SCREEN
 #include "Adafruit_GC9A01A.h"
 #include "Arduino.h"
 #include "Version.h"
@@ -8,17 +9,21 @@
 #include "ImageLibrary/ImageLibrary.h"
 #include "Screenfunctions.h"
 #include "Globals.h"
+#include "BatteryMonitor.h"
 
 // Global TFT object - will be initialized dynamically
 Adafruit_GC9A01A tft(-1, -1, -1);  // Temporary pins, will be reinitialized
 
 // Global canvas declarations
 static GFXcanvas16 backgroundCanvas(240, 240);
-static GFXcanvas16 imageCanvas(240, 240);
 static GFXcanvas16 staticCanvas(240, 100);
 
 screenselections selectScreen;
 
+size_t canvasBytes() {
+  return (size_t)(backgroundCanvas.width() * backgroundCanvas.height() + staticCanvas.width() * staticCanvas.height()) * sizeof(uint16_t);
+}
+
 void selectScreens(uint8_t binaryCode) {
   // Use hwPins from handyHelpers
   for (int i = 0; i < 6; i++) {
@@ -43,9 +48,7 @@ void initDisplays() {
   tft = Adafruit_GC9A01A(hwPins.tft_cs, hwPins.tft_dc, hwPins.tft_rst);
   
   selectScreens(ALL);  // Select all screens
-  delay(500);
-  tft.begin();  // Initialize the display
-  delay(1000);
+  tft.begin();  // Initialize the display, waits the reset and sleep out times of the GC9A01A itself
   tft.fillScreen(GC9A01A_BLACK);
 
   selectScreens(XXYY);
@@ -55,18 +58,50 @@ void initDisplays() {
   tft.setRotation(2);
 
   selectScreens(NO_ONE);  // Deactivate all screens
-  delay(100);
   
   Serial.println("Displays initialized successfully!");
 }
 
+// Warm sleep: the GC9A01A keeps its frame memory in sleep mode, so the faces need no redraw on resume
+void sleepDisplays() {
+  selectScreens(ALL);
+  tft.sendCommand(GC9A01A_SLPIN);
+  selectScreens(NO_ONE);
+}
+
+void resumeDisplays() {
+  for (int i = 0; i < 6; i++) {
+    pinMode(hwPins.screen_cs[i], OUTPUT);
+    digitalWrite(hwPins.screen_cs[i], HIGH);
+  }
+  pinMode(hwPins.tft_rst, OUTPUT);
+  digitalWrite(hwPins.tft_rst, HIGH);  //held high during the sleep, a reset would clear the frame memory
+
+  tft = Adafruit_GC9A01A(hwPins.tft_cs, hwPins.tft_dc);  //no reset pin: begin() is not called either
+  tft.initSPI();
+  selectScreens(ALL);
+  tft.sendCommand(GC9A01A_SLPOUT);
+  delay(5);  //GC9A01A: 5 ms after sleep out before the next command
+  selectScreens(NO_ONE);
+}
+
+// Sleep mode of single faces keeps SPI and the frame memory, used by the power manager
+void setScreensAsleep(uint8_t screens, bool asleep) {
+  selectScreens(screens);
+  tft.sendCommand(asleep ? GC9A01A_SLPIN : GC9A01A_SLPOUT);
+  if (!asleep) {
+    delay(5);
+  }
+  selectScreens(NO_ONE);
+}
+
 void blankScreen(uint8_t screens) {
   selectScreens(screens);
   tft.fillScreen(GC9A01A_BLACK);
 }
 
 // Function to blend colors with transparency
-uint16_t blendColor(uint16_t foreground, uint16_t background, float alpha) {
+uint16_t HOT_PATH blendColor(uint16_t foreground, uint16_t background, float alpha) {
   // Constrain alpha between 0 and 1
   alpha = constrain(alpha, 0.0, 1.0);
 
@@ -114,43 +149,26 @@ void displayImageWithBackground(const unsigned short* image, uint8_t screens) {
       backgroundColor = 0x0000;  // Black
   }
 
-  // Fill background canvas with selected color
-  backgroundCanvas.fillScreen(backgroundColor);
-
-  // Clear image canvas
-  imageCanvas.fillScreen(0x0000);  // Transparent black
-
-  // Draw image on image canvas
-  for (int y = 0; y < HEIGHT; y++) {
-    for (int x = 0; x < WIDTH; x++) {
-      // Calculate pixel index
-      uint32_t pixelIndex = y * WIDTH + x;
-
-      // Read pixel color from PROGMEM
-      uint16_t pixelColor = pgm_read_word(&image[pixelIndex]);
+  // Push final canvas to display
+  tft.drawRGBBitmap(0, 0, composeImage(image, backgroundColor), WIDTH, HEIGHT);
+}
 
-      // Draw non-transparent pixels
-      if (pixelColor != 0x0000) {
-        imageCanvas.drawPixel(x, y, pixelColor);
-      }
-    }
+// Composite the non-black pixels of image over a background color, returns the 240x240 frame buffer.
+// Writes the canvas buffer directly: a library call per pixel would run from flash again
+uint16_t *HOT_PATH composeImage(const unsigned short* image, uint16_t backgroundColor) {
+  uint16_t *frame = backgroundCanvas.getBuffer();
+  if (!frame) {
+    return frame;
   }
-
-  // Overlay image canvas onto background canvas
-  for (int y = 0; y < HEIGHT; y++) {
-    for (int x = 0; x < WIDTH; x++) {
-      // Get pixel from image canvas
-      uint16_t imagePixel = imageCanvas.getPixel(x, y);
-
-      // If pixel is not transparent, draw it on background canvas
-      if (imagePixel != 0x0000) {
-        backgroundCanvas.drawPixel(x, y, imagePixel);
-      }
-    }
+  for (uint32_t pixelIndex = 0; pixelIndex < WIDTH * HEIGHT; pixelIndex++) {
+    uint16_t pixelColor = pgm_read_word(&image[pixelIndex]);  //image streams from flash through the data cache
+    frame[pixelIndex] = pixelColor != 0x0000 ? pixelColor : backgroundColor;  //black is transparent
   }
+  return frame;
+}
 
-  // Push final canvas to display
-  tft.drawRGBBitmap(0, 0, backgroundCanvas.getBuffer(), WIDTH, HEIGHT);
+const unsigned short* circleImage() {
+  return circle;
 }
 
 void displayCircle(uint8_t screens) {
@@ -356,7 +374,7 @@ void printChar(uint8_t screens, char* letters, uint16_t fontcolor, uint16_t bckc
   tft.print(letters);
 }
 
-void drawStringCentered(Adafruit_GFX& gfx, const String& text, int16_t y) {
+void drawStringCentered(Adafruit_GFX& gfx, const char *text, int16_t y) {
   // Variables to store text bounds
   int16_t x1, y1;
   uint16_t w, h;
@@ -374,15 +392,22 @@ void drawStringCentered(Adafruit_GFX& gfx, const String& text, int16_t y) {
   gfx.print(text);
 }
 
-void voltageIndicator(uint8_t screens) {
+// Unless forced, redraws only when the battery monitor has a new value or the screens change
+void voltageIndicator(uint8_t screens, bool force) {
+  static uint32_t drawnSequence = 0;
+  static uint8_t drawnScreens = NO_ONE;
+  if (!force && batteryMonitor.sequence() == drawnSequence && screens == drawnScreens) {
+    return;
+  }
+  drawnSequence = batteryMonitor.sequence();
+  drawnScreens = screens;
+
   char bufferV[10];
   char bufferPerc[10];
   selectScreens(screens);
 
-  // Use hwPins.adc_pin from configuration
-  float voltage = analogReadMilliVolts(hwPins.adc_pin) / 1000.0 * 2.0;
-  float percentage = mapFloat(voltage, MINBATERYVOLTAGE, MAXBATERYVOLTAGE, 0.0, 100.0, true);
-  if (percentage > 100.0) percentage = 100.0;
+  float voltage = batteryMonitor.voltage();
+  float percentage = batteryMonitor.stateOfCharge();
   dtostrf(voltage, 3, 2, bufferV);
   strcat(bufferV, "V");
   dtostrf(percentage, 3, 0, bufferPerc);
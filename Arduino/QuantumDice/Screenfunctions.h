@@ -41,7 +41,13 @@ void selectScreens(uint8_t i);
 uint16_t blendColor(uint16_t foreground, uint16_t background, float alpha);
 void drawDot(int x, int y, float alpha = 1.0, uint16_t color = GC9A01A_WHITE, uint16_t bgColor = GC9A01A_BLACK);
 void displayImageWithBackground(const unsigned short* image, uint8_t screens);
+uint16_t *composeImage(const unsigned short* image, uint16_t backgroundColor);
+const unsigned short* circleImage();  //reference image for benchmarks, the image headers are only included here
 void initDisplays();
+void sleepDisplays();
+void resumeDisplays();
+void setScreensAsleep(uint8_t screens, bool asleep);
+size_t canvasBytes();  //frame buffers, allocated by the canvases at startup
 void blankScreen(uint8_t screens);
 void displayCircle(uint8_t screens);
 void displayCross(uint8_t screens);
@@ -65,8 +71,8 @@ void displayMix1to6(uint8_t screens);
 void displayMix1to6_entAB1(uint8_t screens);
 void displayMix1to6_entAB2(uint8_t screens);
 void printChar(uint8_t screens, char* letters, uint16_t fontcolor, uint16_t bckcolor, int x, int y);
-void voltageIndicator(uint8_t screens);
+void voltageIndicator(uint8_t screens, bool force = false);
 void welcomeInfo(uint8_t screens);
-void drawStringCentered(Adafruit_GFX& gfx, const String& text, int16_t y);
+void drawStringCentered(Adafruit_GFX& gfx, const char *text, int16_t y);
 
 #endif /* SCREENFUNCTIONS_H_ */
\ No newline at end of file
@@ -0,0 +1,210 @@
+#include "defines.h"
+#include "Version.h"
+#include "SelfTest.h"
+#include "handyHelpers.h"
+#include "IMUhelpers.h"
+#include "Screenfunctions.h"
+#include "ScreenStateDefs.h"
+#include "EspNowSensor.h"
+#include "Messages.h"
+#include "FrequencyGovernor.h"
+#include "Orientation.h"
+#include <esp_memory_utils.h>
+#include <esp_heap_caps.h>
+
+static const char *const faceNames[6] = { "X0", "X1", "Y0", "Y1", "Z0", "Z1" };
+static const char *const roleNames[3] = { "A", "B1", "B2" };
+
+// Full frame fill per face: SPI throughput and chip select wiring
+static void testSpi(Print &out) {
+  const uint32_t frameBytes = (uint32_t)WIDTH * HEIGHT * 2;
+  for (uint8_t face = X0; face <= Z1; face++) {
+    uint32_t start = micros();
+    blankScreen(face);
+    uint32_t elapsed = micros() - start;
+    uint32_t rate = elapsed ? frameBytes * 1000ULL / elapsed : 0;  //kB/s
+    out.printf("selftest,%s,spi,%s,%lu,%lu\n", currentConfig.diceId, faceNames[face], (unsigned long)elapsed, (unsigned long)rate);
+  }
+}
+
+// Read latency as seen by the sampler task, last published window
+static void testImu(Print &out, IMUSensor *imuSensor) {
+  const SamplerStats &stats = imuSensor->getSamplerStats();
+  out.printf("selftest,%s,imu,read,%lu,%lu,%lu,%lu,%lu\n", currentConfig.diceId, stats.samples,
+             (unsigned long)stats.meanReadTime, (unsigned long)stats.maxReadTime, stats.late,
+             (unsigned long)imuSensor->getDroppedSamples());
+}
+
+static void testRng(Print &out) {
+  uint32_t total = 0, longest = 0;
+  uint8_t fails = 0;
+  for (uint8_t i = 0; i < SELFTEST_RNG_BLOCKS; i++) {
+    uint32_t start = micros();
+    if (!readRandomBlock()) {
+      fails++;
+    }
+    uint32_t elapsed = micros() - start;
+    total += elapsed;
+    longest = max(longest, elapsed);
+  }
+  out.printf("selftest,%s,atecc,block,%s,%u,%lu,%lu,%u\n", currentConfig.diceId, randomChipPresent ? "present" : "absent",
+             SELFTEST_RNG_BLOCKS, (unsigned long)(total / SELFTEST_RNG_BLOCKS), (unsigned long)longest, fails);
+}
+
+// Round trip and delivery rate to one peer, echoed by StateMachine::update() on the other die
+static void testPeer(Print &out, Roles roleSelf, Roles peer) {
+  uint8_t *mac = getMacForRole(peer);
+  uint8_t received = 0;
+  uint32_t total = 0, longest = 0;
+  unsigned long dropped = 0;
+  message ping = {};
+  ping.type = MESSAGE_TYPE_PING;
+  ping.senderRole = roleSelf;
+
+  for (uint16_t sequence = 0; sequence < SELFTEST_PINGS; sequence++) {
+    ping.data.ping.sequence = sequence;
+    ping.data.ping.sentTime = micros();
+    if (!EspNowSensor<message>::Send(ping, mac)) {
+      continue;
+    }
+    unsigned long waitStart = millis();
+    bool answered = false;
+    while (!answered && millis() - waitStart < SELFTEST_PING_TIMEOUT) {
+      message data;
+      if (!EspNowSensor<message>::Poll(&data)) {
+        delay(1);
+        continue;
+      }
+      if (data.type == MESSAGE_TYPE_PONG && data.senderRole == peer && data.data.ping.sequence == sequence) {
+        uint32_t roundTrip = micros() - data.data.ping.sentTime;
+        total += roundTrip;
+        longest = max(longest, roundTrip);
+        received++;
+        answered = true;
+      } else if (data.type == MESSAGE_TYPE_PING) {  //the peer runs its self test as well
+        Roles pinger = data.senderRole;
+        data.type = MESSAGE_TYPE_PONG;
+        data.senderRole = roleSelf;
+        EspNowSensor<message>::Send(data, getMacForRole(pinger));
+      } else {
+        dropped++;
+      }
+    }
+  }
+  out.printf("selftest,%s,espnow,%s,%02X:%02X:%02X:%02X:%02X:%02X,%u,%u,%lu,%lu,%lu\n", currentConfig.diceId, roleNames[(uint8_t)peer],
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5], SELFTEST_PINGS, received,
+             (unsigned long)(received ? total / received : 0), (unsigned long)longest, dropped);
+}
+
+// Draw time of every screen state on one face
+static void testRender(Print &out) {
+  for (uint8_t screenState = 0; screenState < (uint8_t)ScreenStates::COUNT; screenState++) {
+    uint32_t start = micros();
+    callFunction((ScreenStates)screenState, X0);
+    uint32_t elapsed = micros() - start;
+    out.printf("selftest,%s,render,%s,%lu\n", currentConfig.diceId, screenStateName((ScreenStates)screenState), (unsigned long)elapsed);
+  }
+}
+
+// Classifier over all 24 mountings: every signed permutation matrix, each face up with some tilt.
+// Mirror images (determinant -1) must be rejected by validMountingMatrix()
+static void testOrientation(Print &out) {
+  static const uint8_t permutations[6][3] = { { 0, 1, 2 }, { 0, 2, 1 }, { 1, 0, 2 }, { 1, 2, 0 }, { 2, 0, 1 }, { 2, 1, 0 } };
+  static const UpSide faceZero[3] = { UpSide::X0, UpSide::Y0, UpSide::Z0 };
+  static const UpSide faceOne[3] = { UpSide::X1, UpSide::Y1, UpSide::Z1 };
+  unsigned rotations = 0, mirrors = 0, faces = 0, failures = 0;
+  for (const uint8_t *permutation : permutations) {
+    for (uint8_t signs = 0; signs < 8; signs++) {
+      int8_t mounting[MOUNTING_SIZE] = {};
+      for (uint8_t row = 0; row < 3; row++) {
+        mounting[row * 3 + permutation[row]] = (signs >> row) & 1 ? -1 : 1;
+      }
+      if (!validMountingMatrix(mounting)) {
+        mirrors++;
+        continue;
+      }
+      rotations++;
+      for (uint8_t axis = 0; axis < 3; axis++) {
+        for (int8_t sign = -1; sign <= 1; sign += 2) {
+          float dice[3] = {};
+          dice[axis] = sign * 9.6f;
+          dice[(axis + 1) % 3] = 2.0f;  //tilted, still well inside the margin
+          float sensor[3];              //sensor = transpose(M) * dice
+          for (uint8_t col = 0; col < 3; col++) {
+            sensor[col] = mounting[col] * dice[0] + mounting[3 + col] * dice[1] + mounting[6 + col] * dice[2];
+          }
+          Orientation orientation = classifyOrientation(mounting, sensor[0], sensor[1], sensor[2]);
+          faces++;
+          if (orientation.upSide != (sign > 0 ? faceZero[axis] : faceOne[axis])) {
+            failures++;
+          }
+        }
+      }
+    }
+  }
+  out.printf("selftest,%s,orientation,%u,%u,%u,%u,%s\n", currentConfig.diceId, rotations, mirrors, faces, failures,
+             validMountingMatrix(currentConfig.mounting) ? "valid" : "invalid");
+}
+
+extern "C" int _iram_start, _iram_end;  //linker script
+
+// Itanium C++ ABI: a non-virtual member function pointer starts with the code address
+template <typename F>
+static const void *codeAddress(F function) {
+  const void *address;
+  memcpy(&address, &function, sizeof(address));
+  return address;
+}
+
+struct PlacementImuSensor : IMUSensor {
+  static const void *updateUpVectorAddress() {
+    return codeAddress(&PlacementImuSensor::updateUpVector);
+  }
+};
+
+// Hot paths in IRAM (HOT_PATH in defines.h), IRAM in use and the internal RAM it can still grow into
+static void testPlacement(Print &out) {
+  struct {
+    const char *name;
+    const void *address;
+  } hotPaths[] = {
+    { "onDataRecv", EspNowSensor<message>::ReceiveCallback() },
+    { "promiscuousRxCb", EspNowSensor<message>::RssiCallback() },
+    { "updateUpVector", PlacementImuSensor::updateUpVectorAddress() },
+    { "blendColor", codeAddress(&blendColor) },
+    { "composeImage", codeAddress(&composeImage) },
+  };
+  for (const auto &hotPath : hotPaths) {
+    out.printf("selftest,%s,iram,%s,%s,0x%08lx\n", currentConfig.diceId, hotPath.name,
+               esp_ptr_in_iram(hotPath.address) ? "iram" : "flash", (unsigned long)hotPath.address);
+  }
+  out.printf("selftest,%s,iram,used,%lu,%lu\n", currentConfig.diceId, (unsigned long)((uint8_t *)&_iram_end - (uint8_t *)&_iram_start),
+             (unsigned long)heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+}
+
+void runSelfTest(Print &out, StateMachine &stateMachine) {
+  FrequencyBoost boost(false);  //comparable timings between units
+  unsigned long start = millis();
+  out.printf("selftest,%s,version,%s,%lu\n", currentConfig.diceId, VERSION, (unsigned long)getCpuFrequencyMhz());
+
+  testPlacement(out);
+  testOrientation(out);
+  testSpi(out);
+  testImu(out, stateMachine.getImuSensor());
+  testRng(out);
+  Roles roleSelf = stateMachine.getRoleSelf();
+  if (roleSelf == Roles::NONE) {
+    out.printf("selftest,%s,espnow,skipped\n", currentConfig.diceId);
+  } else {
+    for (uint8_t peer = (uint8_t)Roles::ROLE_A; peer <= (uint8_t)Roles::ROLE_B2; peer++) {
+      if ((Roles)peer != roleSelf) {
+        testPeer(out, roleSelf, (Roles)peer);
+      }
+    }
+  }
+  testRender(out);
+
+  out.printf("selftest,%s,done,%lu\n", currentConfig.diceId, millis() - start);
+  invalidateScreens();
+  refreshScreens();
+}
@@ -0,0 +1,17 @@
+#ifndef SELFTEST_H_
+#define SELFTEST_H_
+
+// Hardware self test, to compare hand-assembled units and spot degraded parts.
+// Entered by a triple click or the "selftest" serial command and run from loop(): the state machine is
+// paused, the faces flash and radio messages other than the test pings are dropped while it runs.
+// Every result is one CSV line starting with selftest,<dice id>,<kind> (see technical documentation.md).
+#include <Arduino.h>
+#include "StateMachine.h"
+
+#define SELFTEST_PINGS 20           //ESP-NOW round trips per peer
+#define SELFTEST_PING_TIMEOUT 100   //ms to wait for each echo
+#define SELFTEST_RNG_BLOCKS 10      //ATECC random blocks to time
+
+void runSelfTest(Print &out, StateMachine &stateMachine);
+
+#endif /* SELFTEST_H_ */
@@ -0,0 +1,253 @@
+#include "defines.h"
+#include "SerialCommands.h"
+#include "DeferredLog.h"
+#include "handyHelpers.h"
+#include "TracePoints.h"
+#include "LoopProfiler.h"
+#include "Benchmarks.h"
+#include "BootSequencer.h"
+#include "PowerManager.h"
+#include "I2CScheduler.h"
+#include "MemoryBudget.h"
+#include "SyntheticIMU.h"
+#include "MotionTuner.h"
+
+static IMUSensor *commandImuSensor = nullptr;
+static char commandLine[SERIAL_COMMAND_LENGTH];
+static uint8_t commandLength = 0;
+
+typedef void (*CommandHandler)(const char *args);
+
+struct SerialCommand {
+  const char *name;
+  CommandHandler handler;
+  const char *help;
+};
+
+static void commandHelp(const char *args);
+
+// Motion and proximity parameters that can be tuned at runtime
+static void printParams() {
+  consoleOut.printf("threshold  %.2f m/s2 (moving above)\n", commandImuSensor->getThreshold());
+  consoleOut.printf("stabletime %lu ms (still before not moving)\n", commandImuSensor->getStableTime());
+  consoleOut.printf("tumble     %.2f revolutions\n", currentConfig.tumbleConstant);
+  consoleOut.printf("rssi       %d dBm\n", currentConfig.rssiLimit);
+}
+
+static void commandParams(const char *args) {
+  printParams();
+}
+
+static void commandSet(const char *args) {
+  char name[16];
+  float value;
+  if (sscanf(args, "%15s %f", name, &value) != 2) {
+    consoleOut.println("usage: set <threshold|stabletime|tumble|rssi> <value>");
+    return;
+  }
+  if (strcmp(name, "threshold") == 0 && value > 0) {
+    commandImuSensor->setThreshold(value);
+  } else if (strcmp(name, "stabletime") == 0 && value >= 0) {
+    commandImuSensor->setStableTime((unsigned long)value);
+  } else if (strcmp(name, "tumble") == 0 && value > 0 && value <= 10.0) {  //same range as validateConfig()
+    currentConfig.tumbleConstant = value;
+  } else if (strcmp(name, "rssi") == 0 && value <= 0 && value >= -100) {
+    currentConfig.rssiLimit = (int8_t)value;
+  } else {
+    consoleOut.printf("invalid parameter or value: %s\n", args);
+    return;
+  }
+  printParams();
+}
+
+// Throw recorder: RAM window and flash snapshots as CSV
+static void commandTrace(const char *args) {
+  ThrowRecorder &recorder = commandImuSensor->getRecorder();
+  unsigned int slot;
+  if (strcmp(args, "save") == 0) {
+    if (!recorder.requestSnapshot(SnapshotReason::REQUEST)) {
+      consoleOut.println("snapshot still being written");
+    }
+  } else if (strcmp(args, "list") == 0) {
+    recorder.listSnapshots(consoleOut);
+  } else if (sscanf(args, "show %u", &slot) == 1) {
+    recorder.printSnapshot(consoleOut, (uint8_t)slot);
+  } else if (args[0] == '\0') {
+    recorder.printCsv(consoleOut);
+  } else {
+    consoleOut.println("usage: trace [save|list|show <slot>]");
+  }
+}
+
+#if DEBUG == 1
+// Runtime log switches per module
+static void commandLog(const char *args) {
+  char name[16], value[4];
+  if (sscanf(args, "%15s %3s", name, value) == 2) {
+    for (uint8_t module = 0; module < LOG_MODULE_COUNT; module++) {
+      if (strcmp(name, logModuleName(module)) == 0) {
+        if (strcmp(value, "on") == 0) logModulesEnabled |= (1 << module);
+        else logModulesEnabled &= ~(1 << module);
+      }
+    }
+  }
+  for (uint8_t module = 0; module < LOG_MODULE_COUNT; module++) {
+    consoleOut.printf("%-7s %s\n", logModuleName(module),
+                  !((LOG_MODULES_COMPILED >> module) & 1) ? "not compiled" : logEnabled(module) ? "on" : "off");
+  }
+  consoleOut.printf("dropped %lu bytes\n", deferredLog.getDropped());
+}
+#endif
+
+// Latency trace as Chrome trace JSON
+static void commandPerf(const char *args) {
+  char name[16], value[4];
+  if (strcmp(args, "clear") == 0) {
+    clearTrace();
+  } else if (sscanf(args, "%15s %3s", name, value) == 2) {
+    for (uint8_t point = 0; point < (uint8_t)TracePoint::COUNT; point++) {
+      if (strcmp(name, tracePointName(point)) == 0) {
+        if (strcmp(value, "on") == 0) traceMask |= (1 << point);
+        else traceMask &= ~(1 << point);
+      }
+    }
+    for (uint8_t point = 0; point < (uint8_t)TracePoint::COUNT; point++) {
+      consoleOut.printf("%-13s %s\n", tracePointName(point), ((traceMask >> point) & 1) ? "on" : "off");
+    }
+  } else {
+    printTraceJson(consoleOut);
+  }
+}
+
+// Loop profiler histograms
+static void commandProf(const char *args) {
+  unsigned long budget;
+  if (strcmp(args, "reset") == 0) {
+    loopProfiler.clear();
+  } else if (sscanf(args, "budget %lu", &budget) == 1) {
+    loopProfiler.setBudget(budget);
+  } else {
+    loopProfiler.print(consoleOut);
+  }
+}
+
+// Power tier and energy estimate
+static void commandPower(const char *args) {
+  if (strcmp(args, "reset") == 0) {
+    powerManager.clear();
+#if DEV_TOOLS == 1
+  } else if (strcmp(args, "sim") == 0) {
+    simulatePowerDay(consoleOut);
+#endif
+  } else {
+    powerManager.print(consoleOut);
+  }
+}
+
+// I2C bus utilisation and latency per device
+static void commandI2c(const char *args) {
+  if (strcmp(args, "reset") == 0) {
+    i2cScheduler.clear();
+  } else if (strcmp(args, "stress") == 0) {
+    i2cScheduler.stress(consoleOut);
+  } else {
+    i2cScheduler.print(consoleOut);
+  }
+}
+
+static void commandMem(const char *args) {
+  printMemoryBudget(consoleOut);
+}
+
+static void commandBoot(const char *args) {
+  printBootTimes(consoleOut);
+}
+
+#if DEV_TOOLS == 1
+static void commandBench(const char *args) {
+  runBenchmarks(consoleOut);
+}
+
+static void commandSynth(const char *args) {
+  unsigned long events = SYNTH_SCORE_EVENTS;
+  sscanf(args, "%lu", &events);
+  scoreSyntheticEvents(consoleOut, commandImuSensor, events, strstr(args, "list") != nullptr);
+}
+
+static void commandTune(const char *args) {
+  unsigned long events = TUNE_DEFAULT_EVENTS;
+  sscanf(args, "%lu", &events);
+  tuneMotion(consoleOut, commandImuSensor, events, strstr(args, "apply") != nullptr);
+}
+#endif
+
+static void commandSelfTest(const char *args) {
+  selfTestRequested = true;  //run from loop(), which owns the state machine
+}
+
+static const SerialCommand commands[] = {
+  { "help", commandHelp, "list commands" },
+  { "params", commandParams, "print the tunable parameters" },
+  { "set", commandSet, "set <name> <value>, change a parameter until reboot" },
+#if DEBUG == 1
+  { "log", commandLog, "[<module> on|off], debug output per module" },
+#endif
+  { "selftest", commandSelfTest, "hardware self test of displays, IMU, ATECC and radio as CSV" },
+  { "boot", commandBoot, "stage times of the last boot as CSV" },
+#if DEV_TOOLS == 1
+  { "bench", commandBench, "microbenchmarks of the hot paths as CSV" },
+  { "synth", commandSynth, "[<events>] [list], score the motion detection on synthetic events, faster than real time" },
+  { "tune", commandTune, "[<events>] [apply], search threshold, stabletime and tumble on synthetic events on both cores" },
+  { "power", commandPower, "[reset|sim], power tier, estimated mAh per state and subsystem, battery life" },
+#else
+  { "power", commandPower, "[reset], power tier, estimated mAh per state and subsystem, battery life" },
+#endif
+  { "mem", commandMem, "static RAM, buffers per subsystem, heap, PSRAM and task stacks as CSV" },
+  { "i2c", commandI2c, "[reset|stress], I2C bus use and latency per device, IMU jitter under RNG load" },
+  { "prof", commandProf, "[reset|budget <us>], loop, state and IMU timing histograms" },
+  { "perf", commandPerf, "[clear|<point> on|off], latency trace points as Chrome trace JSON" },
+  { "trace", commandTrace, "[save|list|show <slot>], IMU trace of the last seconds as CSV" },
+};
+
+static void commandHelp(const char *args) {
+  for (const SerialCommand &command : commands) {
+    consoleOut.printf("%-8s %s\n", command.name, command.help);
+  }
+}
+
+static void executeCommand(char *line) {
+  char *args = strchr(line, ' ');
+  if (args) {
+    *args++ = '\0';
+  } else {
+    args = line + strlen(line);
+  }
+  for (const SerialCommand &command : commands) {
+    if (strcmp(line, command.name) == 0) {
+      command.handler(args);
+      return;
+    }
+  }
+  consoleOut.printf("unknown command: %s (try help)\n", line);
+}
+
+void initSerialCommands(IMUSensor *imuSensor) {
+  commandImuSensor = imuSensor;
+}
+
+void handleSerialCommands() {
+  while (Serial.available() > 0) {
+    char c = Serial.read();
+    if (c == '\n' || c == '\r') {
+      if (commandLength > 0) {
+        commandLine[commandLength] = '\0';
+        commandLength = 0;
+        if (commandImuSensor) {
+          executeCommand(commandLine);
+        }
+      }
+    } else if (commandLength < SERIAL_COMMAND_LENGTH - 1) {
+      commandLine[commandLength++] = c;
+    }
+  }
+}
@@ -0,0 +1,14 @@
+#ifndef SERIALCOMMANDS_H_
+#define SERIALCOMMANDS_H_
+
+// Line based commands on the debug serial port, for tuning and diagnostics without reflashing.
+// Type "help" for the list. Changes are not stored in EEPROM.
+#include <Arduino.h>
+#include "IMUhelpers.h"
+
+#define SERIAL_COMMAND_LENGTH 64
+
+void initSerialCommands(IMUSensor *imuSensor);
+void handleSerialCommands();  //non blocking, call from loop()
+
+#endif /* SERIALCOMMANDS_H_ */
@@ -1,36 +1,22 @@
+#define LOG_MODULE LOG_STATE
 #include "Arduino.h"
 #include "defines.h"
 #include "ScreenStateDefs.h"
+#include "DiceOutcome.h"
+#include "Orientation.h"
+#include "TracePoints.h"
+#include "LoopProfiler.h"
 #include "handyHelpers.h"
 #include "IMUhelpers.h"
 #include "Screenfunctions.h"
 #include "StateMachine.h"
 #include "EspNowSensor.h"
+#include "Messages.h"
+#include "WarmSleep.h"
+#include "PowerManager.h"
+#include "BatteryMonitor.h"
+#include "FrequencyGovernor.h"
 
-typedef enum _message_type {
-  MESSAGE_TYPE_WATCH_DOG,
-  MESSAGE_TYPE_MEASUREMENT,
-  MESSAGE_TYPE_ENTANGLE_REQUEST,
-  MESSAGE_TYPE_ENTANGLE_CONFIRM,
-  MESSAGE_TYPE_ENTANGLE_STOP
-} message_type;
-
-typedef struct _message {
-  message_type type;
-  Roles senderRole;
-  union _data {
-    struct _watchDogData {
-      State state;
-    } watchDog;
-    struct _measurementData {
-      State state;
-      DiceStates diceState;
-      MeasuredAxises measureAxis;
-      DiceNumbers diceNumber;
-      UpSide upSide;
-    } measurement;
-  } data;
-} message;
 
 
 //definitions of functions related to states
@@ -111,38 +97,7 @@ void printStateName(const char* objectName, State state) {
   if (state != previousState) {
     debug(objectName);
     debug(": ");
-    switch (state) {
-      case State::IDLE:
-        debugln("IDLE");
-        break;
-      case State::INITSINGLE:
-        debugln("INITSINGLE");
-        break;
-      case State::INITENTANGLED_AB1:
-        debugln("INITENTANGLED_AB1");
-        break;
-      case State::INITENTANGLED_AB2:
-        debugln("INITENTANGLED_AB2");
-        break;
-      case State::INITSINGLE_AFTER_ENT:
-        debugln("INITSINGLE_AFTER_ENT");
-        break;
-      case State::WAITFORTHROW:
-        debugln("WAITFORTHROW");
-        break;
-      case State::THROWING:
-        debugln("THROWING");
-        break;
-      case State::INITMEASURED:
-        debugln("INITMEASURED");
-        break;
-      case State::LOWBATTERY:
-        debugln("LOWBATTERY");
-        break;
-      case State::CLASSIC_STATE:
-        debugln("CLASSIC_STATE");
-        break;
-    }
+    debugln(stateName(state));
     previousState = state;  // Update previousState
   }
 }
@@ -230,11 +185,47 @@ const StateTransition StateMachine::stateTransitions[] = {
 
 //declaration of instance
 StateMachine::StateMachine()
-  : currentState(State::IDLE), stateEntryTime(0) {
+  : currentState(State::IDLE), stateEntryTime(0), measurementFails(0) {
   // Constructor does not call onEntry. That's done in StateMachine::begin()
 }
 
 void StateMachine::begin() {
+  beginRadio();
+
+  Serial.println("StateMachine Begin: Calling onEntry for initial state");
+  (this->*stateFunctions[static_cast<int>(currentState)].onEntry)();
+}
+
+void StateMachine::resume(const DiceSnapshot &snapshot) {
+  beginRadio();
+
+  currentState = snapshot.state;
+  stateSelf = snapshot.state;
+  diceStateSelf = snapshot.diceState;
+  prevDiceStateSelf = snapshot.prevDiceState;
+  diceNumberSelf = snapshot.diceNumber;
+  upSideSelf = snapshot.upSide;
+  prevUpSideSelf = snapshot.prevUpSide;
+  measureAxisSelf = snapshot.measureAxis;
+  prevMeasureAxisSelf = snapshot.prevMeasureAxis;
+  stateSister = snapshot.stateSister;
+  diceStateSister = snapshot.diceStateSister;
+  diceNumberSister = snapshot.diceNumberSister;
+  measureAxisSister = snapshot.measureAxisSister;
+  upSideSister = snapshot.upSideSister;
+  stateEntryTime = millis();  //state timeouts restart
+
+  printStateName("stateMachine resumed", currentState);
+  sendWatchDog();  //the sister may have slept as well
+  refreshScreens();  //only faces that differ from the retained screen states are drawn
+}
+
+DiceSnapshot StateMachine::snapshot() const {
+  return { currentState, diceStateSelf, prevDiceStateSelf, diceNumberSelf, upSideSelf, prevUpSideSelf, measureAxisSelf,
+           prevMeasureAxisSelf, stateSister, diceStateSister, diceNumberSister, measureAxisSister, upSideSister };
+}
+
+void StateMachine::beginRadio() {
   // Initialize ESP-NOW with device A MAC from config
   EspNowSensor<message>::Init(currentConfig.deviceA_mac);
 
@@ -251,17 +242,16 @@ void StateMachine::begin() {
   Serial.println("ESP-NOW initialized successfully!");
 
   EspNowSensor<message>::PrintMacAddress();
-
-  Serial.println("StateMachine Begin: Calling onEntry for initial state");
-  (this->*stateFunctions[static_cast<int>(currentState)].onEntry)();
 }
 
 void StateMachine::changeState(Trigger trigger) {
+  TRACE_SCOPE(CHANGE_STATE, trigger);
   for (const StateTransition& transition : stateTransitions) {
     if (transition.currentState == currentState && transition.trigger == trigger) {
       currentState = transition.nextState;
-      printStateName("stateMachine", currentState);
+      debugRecord(STATE_CHANGE, currentState);
       //add functions called at stateChange.
+      TRACE_SCOPE(ON_ENTRY, currentState);  //onEntry may change state again, the scope keeps the entered one
       (this->*stateFunctions[static_cast<int>(currentState)].onEntry)();
       break;
     }
@@ -273,6 +263,7 @@ void StateMachine::update() {
 
   message data;
 
+  loopProfiler.beginIteration();
   while (EspNowSensor<message>::Poll(&data)) {
     switch (data.type) {
       case MESSAGE_TYPE_WATCH_DOG:  // watch dog, send by all dices
@@ -311,26 +302,57 @@ void StateMachine::update() {
         printRole(data.senderRole);
         entangleStopRcv = true;
         break;
+
+      case MESSAGE_TYPE_PING: {  //self test of another die, echo the payload
+        Roles pinger = data.senderRole;
+        data.type = MESSAGE_TYPE_PONG;
+        data.senderRole = roleSelf;
+        EspNowSensor<message>::Send(data, getMacForRole(pinger));
+        break;
+      }
+
+      case MESSAGE_TYPE_PONG:  //arrived after the self test timed out
+        break;
     }
   }
 
+  loopProfiler.endStage(LoopStage::RADIO);
+
+  bool measuring = currentState == State::THROWING;  //tumble check and measurement at the full clock
+  if (measuring) {
+    governor.boost(false);
+  }
   _imuSensor->update();
+  loopProfiler.endStage(LoopStage::IMU);
+  State profiledState = currentState;
   unsigned long currentTime = millis();
   if (currentTime - lastUpdateTime >= FSM_UPDATE_INTERVAL) {
     //add functions called at state update
-    printDiceStateName("DiceState", diceStateSelf);
+    printDiceStateName(diceStateSelf);
     lastUpdateTime = currentTime;
+    TRACE_SCOPE(WHILE_IN_STATE, currentState);
     (this->*stateFunctions[static_cast<int>(currentState)].whileInState)();
   }
+  if (measuring) {
+    governor.release();
+  }
+  loopProfiler.endStage(LoopStage::STATE);
 
-  checkTimeForDeepSleep(_imuSensor);
+  batteryMonitor.update();
+  governor.update();
+  if (powerManager.update(currentState, !_imuSensor->isNotMoving())) {
+#if WARM_SLEEP_ENABLED
+    enterWarmSleep(*this, _imuSensor);
+#else
+    digitalWrite(REGULATOR_PIN, HIGH);
+#endif
+  }
+  loopProfiler.endStage(LoopStage::SLEEP);
+  loopProfiler.endIteration(profiledState);
 }
 
 void StateMachine::enterIDLE() {
-  debugln("------------ enter IDLE state -------------");
-  printDiceStateName2("Curent diceState: ", diceStateSelf);
-  printDiceStateName2("Previous diceState: ", prevDiceStateSelf);
-  delay(100);
+  debugRecord(STATE_ENTER, currentState, diceStateSelf, prevDiceStateSelf);
 
   stateEntryTime = millis();
   stateSelf = currentState;
@@ -354,10 +376,7 @@ void StateMachine::whileIDLE() {
 }
 
 void StateMachine::enterINITSINGLE() {
-  debugln("------------ enter INITSINGLE state -------------");
-  printDiceStateName2("Curent diceState: ", diceStateSelf);
-  printDiceStateName2("Previous diceState: ", prevDiceStateSelf);
-  delay(100);
+  debugRecord(STATE_ENTER, currentState, diceStateSelf, prevDiceStateSelf);
   stateEntryTime = millis();
   stateSelf = currentState;
   prevDiceStateSelf = diceStateSelf;  //store for the future
@@ -370,10 +389,7 @@ void StateMachine::enterINITSINGLE() {
   refreshScreens();
   sendWatchDog();
 
-  printDiceStateName2("Curent diceState: ", diceStateSelf);
-  printDiceStateName2("Previous diceState: ", prevDiceStateSelf);
-  debugln("------------ exit INITSINGLE state -------------");
-  delay(100);
+  debugRecord(STATE_EXIT, currentState, diceStateSelf, prevDiceStateSelf);
 };
 
 void StateMachine::whileINITSINGLE() {
@@ -385,17 +401,13 @@ void StateMachine::whileINITSINGLE() {
 }
 
 void StateMachine::enterINITENTANGLED_AB1() {
-  debugln("------------ enter INITENTANGLED_AB1 state -------------");
-  printDiceStateName2("Curent diceState: ", diceStateSelf);
-  printDiceStateName2("Previous diceState: ", prevDiceStateSelf);
-  delay(100);
+  debugRecord(STATE_ENTER, currentState, diceStateSelf, prevDiceStateSelf);
   stateEntryTime = millis();
   stateSelf = currentState;
 
   //before changing the entangled states, send the currentstate of B1 to B2
   if (roleSelf == Roles::ROLE_B1) {
     debugln("B1 sends measurement data to B2");
-    delay(100);
     sendMeasurements(roleB2, stateSelf, diceStateSelf, diceNumberSelf, upSideSelf, measureAxisSelf);
   }
 
@@ -428,10 +440,7 @@ void StateMachine::enterINITENTANGLED_AB1() {
   refreshScreens();
   sendWatchDog();
 
-  printDiceStateName2("Curent diceState: ", diceStateSelf);
-  printDiceStateName2("Previous diceState: ", prevDiceStateSelf);
-  debugln("------------ exit INITENTANGLED_AB1 state -------------");
-  delay(100);
+  debugRecord(STATE_EXIT, currentState, diceStateSelf, prevDiceStateSelf);
 }
 
 void StateMachine::whileINITENTANGLED_AB1() {
@@ -443,18 +452,13 @@ void StateMachine::whileINITENTANGLED_AB1() {
 }
 
 void StateMachine::enterINITENTANGLED_AB2() {
-  debugln("------------ enter INITENTANGLED_AB2 state -------------");
-  printDiceStateName2("Curent diceState: ", diceStateSelf);
-  printDiceStateName2("Previous diceState: ", prevDiceStateSelf);
-  delay(100);
+  debugRecord(STATE_ENTER, currentState, diceStateSelf, prevDiceStateSelf);
   stateEntryTime = millis();
   stateSelf = currentState;
-  delay(100);
 
   //before changing the entangled states, send the currentstate of B1 to B2
   if (roleSelf == Roles::ROLE_B2) {
     debugln("B2 sends measurement data to B1");
-    delay(100);
     sendMeasurements(roleB1, stateSelf, diceStateSelf, diceNumberSelf, upSideSelf, measureAxisSelf);
   }
   //set all states
@@ -470,11 +474,9 @@ void StateMachine::enterINITENTANGLED_AB2() {
   if (roleSelf == Roles::ROLE_A) {
     debugln("A send measurement to B2");
     sendMeasurements(roleB2, stateSelf, diceStateSelf, diceNumberSelf, upSideSelf, measureAxisSelf);
-    delay(100);
   } else if (roleSelf == Roles::ROLE_B2) {
     debugln("B2 send measurement to A");
     sendMeasurements(roleA, stateSelf, diceStateSelf, diceNumberSelf, upSideSelf, measureAxisSelf);
-    delay(100);
   }
   //now kill the other entanglement
   if (prevDiceStateSelf == DiceStates::ENTANGLED_AB1) {  //only for A
@@ -487,10 +489,7 @@ void StateMachine::enterINITENTANGLED_AB2() {
   refreshScreens();
   sendWatchDog();
 
-  printDiceStateName2("Curent diceState: ", diceStateSelf);
-  printDiceStateName2("Previous diceState: ", prevDiceStateSelf);
-  debugln("------------ exit INITENTANGLED_AB2 state -------------");
-  delay(100);
+  debugRecord(STATE_EXIT, currentState, diceStateSelf, prevDiceStateSelf);
 }
 
 void StateMachine::whileINITENTANGLED_AB2() {
@@ -502,10 +501,7 @@ void StateMachine::whileINITENTANGLED_AB2() {
 }
 
 void StateMachine::enterINITSINGLE_AFTER_ENT() {
-  debugln("------------ enter INITSINGLE_AFTER_ENT state -------------");
-  printDiceStateName2("Curent diceState: ", diceStateSelf);
-  printDiceStateName2("Previous diceState: ", prevDiceStateSelf);
-  delay(100);
+  debugRecord(STATE_ENTER, currentState, diceStateSelf, prevDiceStateSelf);
   stateEntryTime = millis();
   stateSelf = currentState;
   debugln("entered initSingle after entanglement");
@@ -519,10 +515,7 @@ void StateMachine::enterINITSINGLE_AFTER_ENT() {
   refreshScreens();
   sendWatchDog();
 
-  printDiceStateName2("Curent diceState: ", diceStateSelf);
-  printDiceStateName2("Previous diceState: ", prevDiceStateSelf);
-  debugln("------------ exit INITSINGLE_AFTER_ENT state -------------");
-  delay(100);
+  debugRecord(STATE_EXIT, currentState, diceStateSelf, prevDiceStateSelf);
 }
 
 void StateMachine::whileINITSINGLE_AFTER_ENT() {
@@ -534,10 +527,7 @@ void StateMachine::whileINITSINGLE_AFTER_ENT() {
 }
 
 void StateMachine::enterWAITFORTHROW() {
-  debugln("------------ enter WAIT FOR THROW state -------------");
-  printDiceStateName2("Curent diceState: ", diceStateSelf);
-  printDiceStateName2("Previous diceState: ", prevDiceStateSelf);
-  delay(100);
+  debugRecord(STATE_ENTER, currentState, diceStateSelf, prevDiceStateSelf);
   stateEntryTime = millis();
   stateSelf = currentState;     //all other states are unchanged.
   _imuSensor->reset();          //prepare for tumbling
@@ -561,7 +551,9 @@ void StateMachine::whileWAITFORTHROW() {
   } else if (longclicked) {
     longclicked = false;
     changeState(Trigger::buttonPressed);
-  } else if (_imuSensor->tumbled(currentConfig.tumbleConstant)) {  // Use tumble constant from config
+  } else if (_imuSensor->takeMotionStop()) {  //put down again without a tumble: handling, not a throw
+    _imuSensor->reset();
+  } else if (_imuSensor->motionState() != MotionState::STILL && _imuSensor->tumbled(currentConfig.tumbleConstant)) {  // Use tumble constant from config
     changeState(Trigger::startRolling);
   } else if (entangleStopRcv) {  //quit the entanglement
     entangleStopRcv = false;
@@ -629,7 +621,7 @@ void StateMachine::whileWAITFORTHROW() {
 }
 
 void StateMachine::enterTHROWING() {
-  debugln("------------ enter THROWING state -------------");
+  debugRecord(STATE_ENTER, currentState, diceStateSelf, prevDiceStateSelf);
   stateEntryTime = millis();
   stateSelf = currentState;
   refreshScreens();
@@ -639,7 +631,13 @@ void StateMachine::enterTHROWING() {
 void StateMachine::whileTHROWING() {
   if (checkMinimumVoltage()) {
     changeState(Trigger::lowbattery);
-  } else if (_imuSensor->isNotMoving() && (withinBounds(abs(_imuSensor->getXGravity()), LOWERBOUND, UPPERBOUND) || withinBounds(abs(_imuSensor->getYGravity()), LOWERBOUND, UPPERBOUND) || withinBounds(abs(_imuSensor->getZGravity()), LOWERBOUND, UPPERBOUND))) {
+  } else if (_imuSensor->isSettled()) {
+    debugln("rest detector settled");
+    changeState(Trigger::nonMoving);
+  } else if (_imuSensor->takeMotionStop() && gravityOnAxis()) {  //no-motion interrupt, also on a surface the window finds too noisy
+    debugln("no-motion interrupt");
+    changeState(Trigger::nonMoving);
+  } else if (_imuSensor->isNotMoving() && gravityOnAxis()) {
     debugln("isNotMoving triggered and Gravity values are within range");
     changeState(Trigger::nonMoving);
   }
@@ -657,178 +655,75 @@ void StateMachine::whileTHROWING() {
   }
 };
 
-void StateMachine::enterINITMEASURED() {
-  debugln("------------ enter MEASUREMENT state -------------");
-  printDiceStateName2("Curent diceState: ", diceStateSelf);
-  printDiceStateName2("Previous diceState: ", prevDiceStateSelf);
-  delay(100);
-  stateEntryTime = millis();
-  stateSelf = currentState;
-  if (_imuSensor->isMoving()) {
-    changeState(Trigger::measurementFail);  //back to throwing state
-  }
-
-  debug("gravity XYZ: ");
-  debug(_imuSensor->getXGravity());
-  debug(", ");
-  debug(_imuSensor->getYGravity());
-  debug(", ");
-  debug(_imuSensor->getZGravity());
-  debugln("");
-
-  // Detection algorithm: set measureAxis and which side up?
-  // Use isNano from config instead of compile-time define
-  if (currentConfig.isNano) {
-    // IMU mounted on X+ side (left) - NANO configuration
-    if (withinBounds(abs(_imuSensor->getXGravity()), LOWERBOUND, UPPERBOUND)) {
-      debugln("measureAxisSelf = MeasuredAxises::ZAXIS;");
-      measureAxisSelf = MeasuredAxises::ZAXIS;
-      if (_imuSensor->getXGravity() < 0) upSideSelf = UpSide::Z1;
-      else upSideSelf = UpSide::Z0;
-    } else if (withinBounds(abs(_imuSensor->getYGravity()), LOWERBOUND, UPPERBOUND)) {
-      debugln("measureAxisSelf = MeasuredAxises::XAXIS;");
-      measureAxisSelf = MeasuredAxises::XAXIS;
-      if (_imuSensor->getYGravity() < 0) upSideSelf = UpSide::X0;
-      else upSideSelf = UpSide::X1;
-    } else if (withinBounds(abs(_imuSensor->getZGravity()), LOWERBOUND, UPPERBOUND)) {
-      debugln("measureAxisSelf = MeasuredAxises::YAXIS;");
-      measureAxisSelf = MeasuredAxises::YAXIS;
-      if (_imuSensor->getZGravity() < 0) upSideSelf = UpSide::Y0;
-      else upSideSelf = UpSide::Y1;
-    } else {
-      debugln("no clear axis");
-      changeState(Trigger::measurementFail);  //back to throwing state
-    }
-  } else {
-    // IMU mounted on Y- side (rear) - DEVKIT configuration
-    if (withinBounds(abs(_imuSensor->getXGravity()), LOWERBOUND, UPPERBOUND)) {
-      debugln("measureAxisSelf = MeasuredAxises::ZAXIS;");
-      measureAxisSelf = MeasuredAxises::ZAXIS;
-      if (_imuSensor->getXGravity() > 0) upSideSelf = UpSide::Z0;
-      else upSideSelf = UpSide::Z1;
-    } else if (withinBounds(abs(_imuSensor->getYGravity()), LOWERBOUND, UPPERBOUND)) {
-      debugln("measureAxisSelf = MeasuredAxises::YAXIS;");
-      measureAxisSelf = MeasuredAxises::YAXIS;
-      if (_imuSensor->getYGravity() > 0) upSideSelf = UpSide::Y1;
-      else upSideSelf = UpSide::Y0;
-    } else if (withinBounds(abs(_imuSensor->getZGravity()), LOWERBOUND, UPPERBOUND)) {
-      debugln("measureAxisSelf = MeasuredAxises::XAXIS;");
-      measureAxisSelf = MeasuredAxises::XAXIS;
-      if (_imuSensor->getZGravity() > 0) upSideSelf = UpSide::X0;
-      else upSideSelf = UpSide::X1;
-    } else {
-      debugln("no clear axis");
-      changeState(Trigger::measurementFail);  //back to throwing state
-    }
-  }
+bool StateMachine::gravityOnAxis() const {
+  return withinBounds(abs(_imuSensor->getXGravity()), LOWERBOUND, UPPERBOUND) || withinBounds(abs(_imuSensor->getYGravity()), LOWERBOUND, UPPERBOUND) || withinBounds(abs(_imuSensor->getZGravity()), LOWERBOUND, UPPERBOUND);
+}
 
-  switch (upSideSelf) {
-    case UpSide::X0:
-      debugln("upside X0");
-      break;
-    case UpSide::X1:
-      debugln("upside X1");
-      break;
-    case UpSide::Y0:
-      debugln("upside Y0");
-      break;
-    case UpSide::Y1:
-      debugln("upside Y1");
-      break;
-    case UpSide::Z0:
-      debugln("upside Z0");
-      break;
-    case UpSide::Z1:
-      debugln("upside Z1");
-      break;
+// Back to throwing. A throw that keeps failing is kept in flash for later analysis
+void StateMachine::measurementFailed() {
+  if (++measurementFails == TRACE_FAIL_SNAPSHOT) {
+    _imuSensor->getRecorder().requestSnapshot(SnapshotReason::MEASUREMENT_FAIL);
   }
+  changeState(Trigger::measurementFail);  //back to throwing state
+}
 
-  // The secret sauce to set diceNumber on top
-switch (diceStateSelf) {
-  case DiceStates::SINGLE:
-    debugln("single state secret sauce");
-    diceNumberSelf = selectOneToSix();
-    break;
-
-  case DiceStates::MEASURED:  // 2 options: same measureAxisSelf or different measureAxis
-    debugln("measured state secret sauce");
-    if (measureAxisSelf != prevMeasureAxisSelf) {  // different, generate random upNumber
-      debugln("measured state. different axis");
-      diceNumberSelf = selectOneToSix();
-    } else {  // same axis
-      debugln("measured state. same axis. do nothing: ");
-      // nothing to do - diceNumberSelf is already set and will be put on top
-    }
-    break;
-
-  case DiceStates::ENTANGLED_AB1:
-  case DiceStates::UN_ENTANGLED_AB1: {
-    debugln("entang AB1 secret sauce");
-    // Determine dice number based on config and sister state
-    if (currentConfig.alwaysSeven) {
-      diceNumberSelf = (measureAxisSister != MeasuredAxises::UNDEFINED) 
-        ? selectOppositeOneToSix(diceNumberSister)
-        : selectOneToSix();
-      debugln((measureAxisSister != MeasuredAxises::UNDEFINED) ? "sister ready. always seven mode" : "different axis");
-    } else {
-      diceNumberSelf = (measureAxisSelf == measureAxisSister)
-        ? selectOppositeOneToSix(diceNumberSister)
-        : selectOneToSix();
-      debugln((measureAxisSelf == measureAxisSister) ? "sister ready. same axis" : "different axis");
-    }
-    // Send measurements to the opponent dice
+void StateMachine::enterINITMEASURED() {
+  debugRecord(STATE_ENTER, currentState, diceStateSelf, prevDiceStateSelf);
+  stateEntryTime = millis();
+  stateSelf = currentState;
+  if (!_imuSensor->isAtRest()) {  //the rest detector decides, no fixed wait
+    measurementFailed();
+    return;
+  }
+
+  // Gravity averaged over the rest window instead of a single sample
+  float xGravity, yGravity, zGravity;
+  _imuSensor->getRestGravity(xGravity, yGravity, zGravity);
+  debugRecord(MEASURE_GRAVITY, xGravity, yGravity, zGravity);
+
+  // Detection algorithm: set measureAxis and which side up? Mounting of the IMU comes from the config
+  Orientation orientation = classifyOrientation(currentConfig.mounting, xGravity, yGravity, zGravity);
+  if (orientation.axis == MeasuredAxises::UNDEFINED) {
+    debugln("no clear axis");
+    measurementFailed();
+    return;
+  }
+  measurementFails = 0;
+  measureAxisSelf = orientation.axis;
+  upSideSelf = orientation.upSide;
+  debugRecord(MEASURE_ORIENTATION, upSideSelf, orientation.margin);
+
+  // The secret sauce to set diceNumber on top. See DiceOutcome.cpp
+  OutcomeInputs outcomeInputs = {
+    diceStateSelf, measureAxisSelf, prevMeasureAxisSelf, diceNumberSelf,
+    measureAxisSister, diceNumberSister, currentConfig.alwaysSeven
+  };
+  Outcome outcome = determineOutcome(outcomeInputs, selectOneToSix);
+  diceNumberSelf = outcome.diceNumber;
+  debugRecord(MEASURE_RULE, outcome.rule);
+
+  // Send measurements to the opponent dice, before any face is drawn
+  if (diceStateSelf == DiceStates::ENTANGLED_AB1 || diceStateSelf == DiceStates::UN_ENTANGLED_AB1) {
     Roles targetRole = (roleSelf == Roles::ROLE_A) ? roleB1 : roleA;
     sendMeasurements(targetRole, stateSelf, DiceStates::MEASURED, diceNumberSelf, upSideSelf, measureAxisSelf);
-    break;
-  }
-
-  case DiceStates::ENTANGLED_AB2:
-  case DiceStates::UN_ENTANGLED_AB2: {
-    debugln("entang AB2 secret sauce");
-    // Determine dice number based on config and sister state
-    if (currentConfig.alwaysSeven) {
-      diceNumberSelf = (measureAxisSister != MeasuredAxises::UNDEFINED)
-        ? selectOppositeOneToSix(diceNumberSister)
-        : selectOneToSix();
-      debugln((measureAxisSister != MeasuredAxises::UNDEFINED) ? "sister ready. always seven mode" : "different axis");
-    } else {
-      diceNumberSelf = (measureAxisSelf == measureAxisSister)
-        ? selectOppositeOneToSix(diceNumberSister)
-        : selectOneToSix();
-      debugln((measureAxisSelf == measureAxisSister) ? "sister ready. same axis" : "different axis");
-    }
-    // Send measurements to the opponent dice
+  } else if (diceStateSelf == DiceStates::ENTANGLED_AB2 || diceStateSelf == DiceStates::UN_ENTANGLED_AB2) {
     Roles targetRole = (roleSelf == Roles::ROLE_A) ? roleB2 : roleA;
     sendMeasurements(targetRole, stateSelf, DiceStates::MEASURED, diceNumberSelf, upSideSelf, measureAxisSelf);
-    break;
   }
 
-  case DiceStates::MEASURED_AFTER_ENT:  // 2 options: no sister diceNumber or with diceNumber
-    debugln("measured after entang secret sauce");
-    if (diceNumberSister == DiceNumbers::NONE) {  // different, generate random upNumber
-      debugln("no diceNumberSister");
-      diceNumberSelf = selectOneToSix();
-    } else {
-      debugln("defined diceNumberSister");
-      diceNumberSelf = diceNumberSister;
-    }
-    break;
-}
-
   prevMeasureAxisSelf = measureAxisSelf;
   prevUpSideSelf = upSideSelf;           // preserve for the history
   prevDiceStateSelf = diceStateSelf;     // store for the future
   diceStateSelf = DiceStates::MEASURED;  // here the final diceState is set to measured
 
-  refreshScreens();  // often redundant, because nothing changed after throwing
-  sendWatchDog();
+  sendWatchDog();     // radio first: the other dice do not wait for our faces
+  refreshScreens();  // up face first. Often redundant, because nothing changed after throwing
 }
 
 void StateMachine::whileINITMEASURED() {
   if (checkMinimumVoltage()) {
     changeState(Trigger::lowbattery);
-  }
-  if (millis() - stateEntryTime > STABTIME) {
+  } else if (_imuSensor->isSettled() || millis() - stateEntryTime > STABTIME) {  //ready for the next throw once the rest window confirms the die lies still
     changeState(Trigger::measureXYZ);
   }
 }
@@ -4,6 +4,7 @@
 #include <Arduino.h>
 #include "IMUhelpers.h"
 #include "Globals.h"
+#include "LogRecords.h"  //State and stateName()
 
 //#include "EntangStateMachine.h"
 
@@ -19,22 +20,10 @@ class StateMachine;  // Forward declaration
 #define IDLETIME 3000                //5000 ms-en
 #define SHOWNEWSTATETIME 1000        //ms-en to show when new state is initated
 #define MAXENTANGLEDWAITTIME 120000  //ms-en wait for throw in entangled wait, befor return to intitSingle state
-#define STABTIME 800                 //ms-en to stabilize after measurement
+#define STABTIME 800                 //ms-en to stabilize after measurement, when the rest detector does not settle earlier
+#define TRACE_FAIL_SNAPSHOT 3        //consecutive measurementFails that store the IMU trace in flash
 //#define WAITTOTHROW 1000            //minumum time it stays in wait to trow
 
-enum class State {
-  IDLE,
-  INITSINGLE,
-  INITENTANGLED_AB1,
-  WAITFORTHROW,
-  THROWING,
-  INITMEASURED,
-  LOWBATTERY,
-  CLASSIC_STATE,
-  INITENTANGLED_AB2,
-  INITSINGLE_AFTER_ENT
-};
-
 enum class Trigger {
   onthemove,
   nonMoving,
@@ -58,12 +47,27 @@ enum class Roles : uint8_t {
   NONE
 };
 
+// Dice and sister states kept in RTC memory over a warm sleep (WarmSleep.h)
+struct DiceSnapshot {
+  State state;
+  DiceStates diceState, prevDiceState;
+  DiceNumbers diceNumber;
+  UpSide upSide, prevUpSide;
+  MeasuredAxises measureAxis, prevMeasureAxis;
+  State stateSister;
+  DiceStates diceStateSister;
+  DiceNumbers diceNumberSister;
+  MeasuredAxises measureAxisSister;
+  UpSide upSideSister;
+};
+
 struct StateTransition {
   State currentState;
   Trigger trigger;
   State nextState;
 };
 
+uint8_t *getMacForRole(Roles role);
 void setInitialState();
 void printStateName(const char *objectName, State state);
 
@@ -71,12 +75,23 @@ class StateMachine {
 public:
   StateMachine();
   void begin();  // New function to initialize the state machine
+  void resume(const DiceSnapshot &snapshot);  //after a warm sleep: same state, no onEntry
+  DiceSnapshot snapshot() const;
+  State getCurrentState() const {
+    return currentState;
+  }
   void changeState(Trigger trigger);
   void update();
 
   void setImuSensor(IMUSensor *imuSensor) {
     _imuSensor = imuSensor;
   }
+  IMUSensor *getImuSensor() const {
+    return _imuSensor;
+  }
+  Roles getRoleSelf() const {
+    return roleSelf;
+  }
 
   //customized functions
   void enterIDLE();
@@ -101,12 +116,15 @@ public:
   void whileINITSINGLE_AFTER_ENT();
 
 private:
+  void beginRadio();
   void determineRoles();
   void sendWatchDog();
   void sendMeasurements(Roles targetRole, State state, DiceStates diceState, DiceNumbers diceNumber, UpSide upSide, MeasuredAxises measureAxis);
   void sendEntangleRequest(Roles targetRole);
   void sendEntanglementConfirm(Roles targetRole);
   void sendStopEntanglement(Roles targetRole);
+  void measurementFailed();
+  bool gravityOnAxis() const;  //one axis carries gravity: lying on a face
 
 private:
   IMUSensor *_imuSensor;
@@ -131,6 +149,7 @@ private:
   bool entangleConfirmRcvB2;
   bool entangleStopRcv;
   bool measurementReceived;
+  uint8_t measurementFails;  //consecutive, reset by a successful measurement
 
   //void printState(State state);
 };
@@ -0,0 +1,399 @@
+#define LOG_MODULE LOG_IMU
+#include "defines.h"
+#include "SyntheticIMU.h"
+#include "esp_timer.h"
+#include "handyHelpers.h"
+#include <new>
+#include <esp_random.h>
+
+void SyntheticIMUSensor::init() {
+  debugln("Synthetic IMU, no BNO055 in use");
+  seed(esp_random());
+  _prevTime = esp_timer_get_time();
+  startEvent(SyntheticEvent::REST, _prevTime);
+}
+
+const char *SyntheticIMUSensor::eventName(SyntheticEvent event) {
+  switch (event) {
+    case SyntheticEvent::REST: return "REST";
+    case SyntheticEvent::THROW: return "THROW";
+    case SyntheticEvent::SLIDE: return "SLIDE";
+    case SyntheticEvent::KNOCK: return "KNOCK";
+    case SyntheticEvent::PICKUP: return "PICKUP";
+    case SyntheticEvent::EDGE: return "EDGE";
+    default: return "UNKNOWN";
+  }
+}
+
+// xorshift32: each generator has its own sequence, so runs on both cores are repeatable per seed
+long SyntheticIMUSensor::randomRange(long low, long high) {
+  _rngState ^= _rngState << 13;
+  _rngState ^= _rngState >> 17;
+  _rngState ^= _rngState << 5;
+  return low + (long)(_rngState % (uint32_t)(high - low));
+}
+
+float SyntheticIMUSensor::noise(float amplitude) {
+  return amplitude * randomRange(-1000, 1001) / 1000.0f;
+}
+
+void SyntheticIMUSensor::startEvent(SyntheticEvent event, int64_t now) {
+  _event = event;
+  _eventStart = now;
+  _eventCount[(uint8_t)event]++;
+
+  // World frame, z up. Random horizontal direction for pushes and tilts
+  float heading = randomRange(0, 628) / 100.0f;
+  _pushX = cosf(heading);
+  _pushY = sinf(heading);
+  _spinX = -_pushY;  //tilt axis perpendicular to the push
+  _spinY = _pushX;
+  _spinZ = 0.0f;
+
+  switch (event) {
+    case SyntheticEvent::THROW: {
+      _eventDuration = 0.3f + randomRange(60, 151) / 100.0f;  //lift + 0.6..1.5 s tumble
+      float speed = randomRange(8, 21);                        //rad/s
+      float x = noise(1.0f), y = noise(1.0f), z = noise(1.0f);
+      float length = sqrtf(x * x + y * y + z * z) + 1e-3f;
+      _spinX = speed * x / length;
+      _spinY = speed * y / length;
+      _spinZ = speed * z / length;
+      _pushX *= 3.0f;
+      _pushY *= 3.0f;
+      break;
+    }
+    case SyntheticEvent::SLIDE:
+      _eventDuration = 0.6f;
+      _pushX *= 2.5f;
+      _pushY *= 2.5f;
+      break;
+    case SyntheticEvent::KNOCK:
+      _eventDuration = 0.04f;
+      _pushX *= 6.0f;
+      _pushY *= 6.0f;
+      break;
+    case SyntheticEvent::PICKUP:
+      _eventDuration = 1.8f;
+      _spinX *= 0.8f;
+      _spinY *= 0.8f;
+      break;
+    case SyntheticEvent::EDGE:
+      _eventDuration = 1.6f;
+      _spinX *= (PI / 4) / 0.3f;  //45 degrees in 0.3 s
+      _spinY *= (PI / 4) / 0.3f;
+      break;
+    default:
+      _eventDuration = _restTime / 1000.0f;
+      break;
+  }
+
+  if (!_offline) {
+    debug("synthetic event: ");
+    debugln(eventName(event));
+  }
+}
+
+// Angular velocity and linear acceleration in the world frame, elapsed seconds into the event
+void SyntheticIMUSensor::motion(float elapsed, float &wx, float &wy, float &wz, float &ax, float &ay, float &az) {
+  wx = wy = wz = 0.0f;
+  ax = ay = az = 0.0f;
+  switch (_event) {
+    case SyntheticEvent::THROW:
+      if (elapsed < 0.3f) {  //lift off the table, slow start of the spin
+        wx = 0.3f * _spinX;
+        wy = 0.3f * _spinY;
+        wz = 0.3f * _spinZ;
+        ax = _pushX;
+        ay = _pushY;
+        az = 5.0f;
+      } else {  //tumble and bounce, spin decays over the last 20%
+        float decay = constrain((_eventDuration - elapsed) / (0.2f * _eventDuration), 0.2f, 1.0f);
+        wx = decay * _spinX;
+        wy = decay * _spinY;
+        wz = decay * _spinZ;
+        ax = noise(3.0f);
+        ay = noise(3.0f);
+        az = noise(3.0f);
+      }
+      break;
+    case SyntheticEvent::SLIDE:
+      if (elapsed < 0.4f) {
+        ax = _pushX;
+        ay = _pushY;
+      } else {  //friction stops it in half the time
+        ax = -2.0f * _pushX;
+        ay = -2.0f * _pushY;
+      }
+      break;
+    case SyntheticEvent::KNOCK:
+      ax = _pushX;
+      ay = _pushY;
+      az = 2.0f;
+      wx = noise(0.5f);
+      wy = noise(0.5f);
+      wz = noise(0.5f);
+      break;
+    case SyntheticEvent::PICKUP:
+      if (elapsed < 0.4f) {
+        az = 3.0f;
+      } else if (elapsed < 0.9f) {
+        wx = _spinX;
+        wy = _spinY;
+      } else if (elapsed < 1.4f) {
+        wx = -_spinX;
+        wy = -_spinY;
+      } else {
+        az = -3.0f;
+      }
+      break;
+    case SyntheticEvent::EDGE:
+      if (elapsed < 0.3f || elapsed >= 1.3f) {  //tip onto the edge, later fall over it
+        wx = _spinX;
+        wy = _spinY;
+      } else {  //balancing
+        wx = noise(0.05f);
+        wy = noise(0.05f);
+      }
+      break;
+    default:
+      break;
+  }
+}
+
+// q = dq * q, world frame angular velocity
+void SyntheticIMUSensor::rotate(float wx, float wy, float wz, float deltaTime) {
+  float speed = sqrtf(wx * wx + wy * wy + wz * wz);
+  if (speed * deltaTime < 1e-6f) {
+    return;
+  }
+  float halfAngle = 0.5f * speed * deltaTime;
+  float dw = cosf(halfAngle);
+  float scale = sinf(halfAngle) / speed;
+  float dx = wx * scale, dy = wy * scale, dz = wz * scale;
+
+  float qw = dw * _qw - dx * _qx - dy * _qy - dz * _qz;
+  float qx = dw * _qx + dx * _qw + dy * _qz - dz * _qy;
+  float qy = dw * _qy + dy * _qw + dz * _qx - dx * _qz;
+  float qz = dw * _qz + dz * _qw + dx * _qy - dy * _qx;
+  float inverseNorm = 1.0f / sqrtf(qw * qw + qx * qx + qy * qy + qz * qz);
+  _qw = qw * inverseNorm;
+  _qx = qx * inverseNorm;
+  _qy = qy * inverseNorm;
+  _qz = qz * inverseNorm;
+}
+
+// Rotate a world vector into the body frame: v' = q* v q
+static void toBody(float qw, float qx, float qy, float qz, float &x, float &y, float &z) {
+  float tx = 2.0f * (-qy * z + qz * y);
+  float ty = 2.0f * (-qz * x + qx * z);
+  float tz = 2.0f * (-qx * y + qy * x);
+  float rx = x + qw * tx + (-qy * tz + qz * ty);
+  float ry = y + qw * ty + (-qz * tx + qx * tz);
+  float rz = z + qw * tz + (-qx * ty + qy * tx);
+  x = rx;
+  y = ry;
+  z = rz;
+}
+
+// Land flat: turn the body axis closest to world up exactly upright
+void SyntheticIMUSensor::snapToFace() {
+  float ux = 0.0f, uy = 0.0f, uz = 1.0f;  //world up in the body frame
+  toBody(_qw, _qx, _qy, _qz, ux, uy, uz);
+
+  // world direction w of that body axis is the world up minus the error, so rotate from w to up
+  float ex = 0.0f, ey = 0.0f, ez = 0.0f;
+  if (fabsf(ux) >= fabsf(uy) && fabsf(ux) >= fabsf(uz)) ex = ux > 0 ? 1.0f : -1.0f;
+  else if (fabsf(uy) >= fabsf(uz)) ey = uy > 0 ? 1.0f : -1.0f;
+  else ez = uz > 0 ? 1.0f : -1.0f;
+  toBody(_qw, -_qx, -_qy, -_qz, ex, ey, ez);  //conjugate: body to world
+
+  float cosAngle = constrain(ez, -1.0f, 1.0f);
+  float sx = ey, sy = -ex;  //w x up
+  float sinAngle = sqrtf(sx * sx + sy * sy);
+  if (sinAngle < 1e-6f) {
+    return;
+  }
+  float angle = atan2f(sinAngle, cosAngle);
+  rotate(sx / sinAngle * angle, sy / sinAngle * angle, 0.0f, 1.0f);
+}
+
+bool SyntheticIMUSensor::readSample(ImuSample &sample) {
+  generate(sample, esp_timer_get_time());
+  return true;
+}
+
+void SyntheticIMUSensor::generate(ImuSample &sample, int64_t now) {
+  float deltaTime = (now - _prevTime) * 1e-6f;
+  _prevTime = now;
+  float elapsed = (now - _eventStart) * 1e-6f;
+
+  if (elapsed >= _eventDuration) {
+    if (_event == SyntheticEvent::REST) {
+      startEvent((SyntheticEvent)randomRange(1, (long)SyntheticEvent::COUNT), now);
+    } else {
+      snapToFace();
+      startEvent(SyntheticEvent::REST, now);
+    }
+    elapsed = 0.0f;
+  }
+
+  float wx, wy, wz, ax, ay, az;
+  motion(elapsed, wx, wy, wz, ax, ay, az);
+  rotate(wx, wy, wz, deltaTime);
+
+  toBody(_qw, _qx, _qy, _qz, wx, wy, wz);
+  toBody(_qw, _qx, _qy, _qz, ax, ay, az);
+  float gx = 0.0f, gy = 0.0f, gz = SYNTH_GRAVITY;  //BNO055 gravity vector points up at rest
+  toBody(_qw, _qx, _qy, _qz, gx, gy, gz);
+
+  sample.timeUs = now;
+  sample.xGyro = wx + SYNTH_GYRO_BIAS + noise(SYNTH_GYRO_NOISE);
+  sample.yGyro = wy + SYNTH_GYRO_BIAS + noise(SYNTH_GYRO_NOISE);
+  sample.zGyro = wz + SYNTH_GYRO_BIAS + noise(SYNTH_GYRO_NOISE);
+  sample.ax = ax + noise(SYNTH_ACCEL_NOISE);
+  sample.ay = ay + noise(SYNTH_ACCEL_NOISE);
+  sample.az = az + noise(SYNTH_ACCEL_NOISE);
+  sample.xGravity = gx + noise(SYNTH_ACCEL_NOISE);
+  sample.yGravity = gy + noise(SYNTH_ACCEL_NOISE);
+  sample.zGravity = gz + noise(SYNTH_ACCEL_NOISE);
+  sample.flags = 0;
+}
+
+void SyntheticIMUSensor::printSensorStats(unsigned long elapsed) {
+  debug(" synthetic events:");
+  for (uint8_t i = 1; i < (uint8_t)SyntheticEvent::COUNT; i++) {
+    debug(" ");
+    debug(eventName((SyntheticEvent)i));
+    debug("=");
+    debug(_eventCount[i]);
+  }
+}
+
+#if DEV_TOOLS == 1
+struct SyntheticScore {
+  unsigned long events;
+  unsigned long detected;  //tumbled() fired between the start of the event and settling
+  unsigned long settled;
+  uint64_t settleTime;     //us from the end of the event to isAtRest()
+};
+
+// Same decisions as the state machine: reset() when waiting for a throw, tumbled() starts a throw,
+// isAtRest() ends it. Simulated time in IMU_SAMPLE_INTERVAL steps, as fast as the CPU allows
+SyntheticResult SyntheticIMUSensor::score(float tumbleConstant, uint32_t events, uint32_t seed, Print *out, bool list) {
+  SyntheticScore scores[(uint8_t)SyntheticEvent::COUNT] = {};
+  this->seed(seed);
+  _offline = true;
+  _restTime = SYNTH_SCORE_REST_TIME;
+  int64_t now = 0;
+  _offlineTimeUs = _prevTime = now;
+  startEvent(SyntheticEvent::REST, now);
+
+  SyntheticEvent label = SyntheticEvent::REST;  //event being scored, REST when none is open
+  bool detected = false;
+  int64_t eventEnd = -1;  //-1: still moving
+  uint32_t started = 0;
+  uint32_t steps = 0;
+  unsigned long start = millis();
+  ImuSample sample;
+
+  auto close = [&](bool settled) {
+    SyntheticScore &score = scores[(uint8_t)label];
+    score.events++;
+    score.detected += detected;
+    if (settled) {
+      score.settled++;
+      score.settleTime += now - eventEnd;
+    }
+    if (out && list) {
+      out->printf("synth,event,%lu,%s,%u,%ld\n", (unsigned long)started, eventName(label), detected,
+                 settled ? (long)((now - eventEnd) / 1000) : -1L);
+    }
+    label = SyntheticEvent::REST;
+  };
+
+  while (started < events || label != SyntheticEvent::REST) {
+    now += IMU_SAMPLE_INTERVAL * 1000;
+    SyntheticEvent before = _event;
+    generate(sample, now);
+    processSample(sample);
+
+    if (_event != before) {
+      if (before == SyntheticEvent::REST) {  //next event
+        if (label != SyntheticEvent::REST) {
+          close(false);  //rest over without settling
+        }
+        if (started == events) {
+          break;
+        }
+        started++;
+        label = _event;
+        detected = false;
+        eventEnd = -1;
+        reset();
+      } else {
+        eventEnd = now;
+      }
+    }
+    if (label != SyntheticEvent::REST) {
+      detected = detected || tumbled(tumbleConstant);
+      if (eventEnd >= 0 && isAtRest()) {
+        close(true);
+      }
+    }
+    if ((++steps & 0x3FF) == 0) {
+      delay(1);  //long runs: let lower priority tasks and the idle task run
+    }
+  }
+
+  SyntheticResult result = {};
+  const SyntheticScore &throws = scores[(uint8_t)SyntheticEvent::THROW];
+  unsigned long negatives = 0, falsePositives = 0, settled = 0;
+  uint64_t settleTime = 0;
+  for (SyntheticEvent event : { SyntheticEvent::SLIDE, SyntheticEvent::KNOCK, SyntheticEvent::PICKUP }) {
+    negatives += scores[(uint8_t)event].events;
+    falsePositives += scores[(uint8_t)event].detected;
+  }
+  for (const SyntheticScore &score : scores) {
+    settled += score.settled;
+    settleTime += score.settleTime;
+  }
+  result.falseNegative = throws.events ? 100.0f * (throws.events - throws.detected) / throws.events : 0.0f;
+  result.falsePositive = negatives ? 100.0f * falsePositives / negatives : 0.0f;
+  result.settleMs = settled ? settleTime / 1000.0f / settled : 0.0f;
+  if (!out) {
+    return result;
+  }
+
+  unsigned long elapsed = max(millis() - start, 1UL);
+  out->println("synth,event,events,detected,settled,settle_ms");
+  for (uint8_t i = 1; i < (uint8_t)SyntheticEvent::COUNT; i++) {
+    const SyntheticScore &score = scores[i];
+    out->printf("synth,%s,%lu,%lu,%lu,%lu\n", eventName((SyntheticEvent)i), score.events, score.detected, score.settled,
+                score.settled ? (unsigned long)(score.settleTime / score.settled / 1000) : 0UL);
+  }
+  out->printf("synth,rates,false_negative,%.2f%%,false_positive,%.2f%%\n", result.falseNegative, result.falsePositive);
+  out->printf("synth,done,%lu events,%lu ms,%.0fx real time\n", (unsigned long)started, elapsed, now / 1000.0f / elapsed);
+  return result;
+}
+
+bool scoreSynthetic(const MotionParams &params, uint32_t events, uint32_t seed, SyntheticResult &result, Print *out, bool list) {
+  SyntheticIMUSensor *generator = new (std::nothrow) SyntheticIMUSensor();  //own detector state, the live sensor keeps running
+  if (!generator) {
+    return false;
+  }
+  generator->setThreshold(params.threshold);
+  generator->setStableTime(params.stableTime);
+  result = generator->score(params.tumble, events, seed, out, list);
+  delete generator;
+  return true;
+}
+
+void scoreSyntheticEvents(Print &out, IMUSensor *live, uint32_t events, bool list) {
+  MotionParams params = { live->getThreshold(), live->getStableTime(), currentConfig.tumbleConstant };
+  SyntheticResult result;
+  if (!scoreSynthetic(params, events, esp_random(), result, &out, list)) {
+    out.println("synth,error,no memory");
+  }
+}
+#endif
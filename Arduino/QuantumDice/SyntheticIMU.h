@@ -0,0 +1,96 @@
+#ifndef SYNTHETICIMU_H_
+#define SYNTHETICIMU_H_
+
+// Synthetic IMU: a rigid cube simulator that replaces the BNO055 to stress-test the motion detection.
+// Generates labelled throws, slides, knocks, pick-ups and edge balances with noise and gyro bias,
+// and feeds them through the normal IMUSensor path (sampler task, rest detector, tumble check).
+// Enable with SYNTHETIC_IMU in defines.h. The "synth" serial command (DEV_TOOLS) runs a separate generator
+// offline, faster than real time, and scores the motion detection against the event labels.
+#include <Arduino.h>
+#include "defines.h"
+#include "IMUhelpers.h"
+
+#define SYNTH_GRAVITY 9.81
+#define SYNTH_GYRO_NOISE 0.01   //rad/s, per sample
+#define SYNTH_ACCEL_NOISE 0.05  //m/s2, per sample
+#define SYNTH_GYRO_BIAS 0.01    //rad/s, constant offset on each gyro axis
+#define SYNTH_REST_TIME 3000    //ms of rest between two events
+#define SYNTH_SCORE_REST_TIME 1000  //ms of rest in a scoring run, enough for the rest detector to settle
+#define SYNTH_SCORE_EVENTS 1000     //default events for "synth"
+
+enum class SyntheticEvent : uint8_t {
+  REST,
+  THROW,   //lift, tumble, land on a face
+  SLIDE,   //pushed over the table, no rotation
+  KNOCK,   //short bump against the table
+  PICKUP,  //lifted, tilted and put back on the same face
+  EDGE,    //balances on an edge, then falls onto a face
+  COUNT
+};
+
+struct MotionParams {  //the tunable detection parameters, see the "set" serial command
+  float threshold;            //m/s2
+  unsigned long stableTime;   //ms
+  float tumble;               //revolutions
+};
+
+struct SyntheticResult {
+  float falseNegative;  //% of throws not detected
+  float falsePositive;  //% of slides, knocks and pick-ups detected as a throw
+  float settleMs;       //mean time from the end of an event to rest
+};
+
+class SyntheticIMUSensor : public IMUSensor {
+public:
+  void init() override;
+
+  SyntheticEvent currentEvent() const {
+    return _event;
+  }
+  static const char *eventName(SyntheticEvent event);
+
+  void generate(ImuSample &sample, int64_t now);  //sample at any time, real or simulated
+#if DEV_TOOLS == 1
+  SyntheticResult score(float tumbleConstant, uint32_t events, uint32_t seed, Print *out, bool list);  //offline run, out may be null
+#endif
+  void seed(uint32_t value) {
+    _rngState = value ? value : 1;  //xorshift state must not be 0
+  }
+
+protected:
+  bool readSample(ImuSample &sample) override;
+  void printSensorStats(unsigned long elapsed) override;
+
+private:
+  void startEvent(SyntheticEvent event, int64_t now);
+  void motion(float elapsed, float &wx, float &wy, float &wz, float &ax, float &ay, float &az);
+  void rotate(float wx, float wy, float wz, float deltaTime);
+  void snapToFace();
+  long randomRange(long low, long high);  //low..high-1, like random()
+  float noise(float amplitude);
+
+  // Orientation of the cube, body to world, unit quaternion
+  float _qw = 1.0f, _qx = 0.0f, _qy = 0.0f, _qz = 0.0f;
+
+  SyntheticEvent _event = SyntheticEvent::REST;
+  int64_t _eventStart = 0;     //us
+  float _eventDuration = 0.0f;  //s
+  float _spinX = 0.0f, _spinY = 0.0f, _spinZ = 0.0f;  //rad/s, throw or tilt rotation
+  float _pushX = 0.0f, _pushY = 0.0f;                 //m/s2, horizontal push
+  int64_t _prevTime = 0;
+  unsigned long _restTime = SYNTH_REST_TIME;
+  uint32_t _rngState = 1;
+  unsigned long _eventCount[(uint8_t)SyntheticEvent::COUNT] = {};
+};
+
+#if DEV_TOOLS == 1
+// Offline scoring with the detection parameters of the live sensor. One CSV line per event type:
+// synth,<event>,<events>,<throws detected>,<settled>,<mean settle ms>, then false negative and false
+// positive rates. THROW should be detected; SLIDE, KNOCK and PICKUP should not; EDGE is only counted.
+// list: also one line per event with its label and the detector decisions
+void scoreSyntheticEvents(Print &out, IMUSensor *live, uint32_t events, bool list);
+// Silent run for the tuner (MotionTuner.h), any task. False when no memory for the generator
+bool scoreSynthetic(const MotionParams &params, uint32_t events, uint32_t seed, SyntheticResult &result, Print *out = nullptr, bool list = false);
+#endif
+
+#endif /* SYNTHETICIMU_H_ */
@@ -0,0 +1,223 @@
+#define LOG_MODULE LOG_IMU
+#include "defines.h"
+#include "ThrowRecorder.h"
+#include "IMUhelpers.h"
+#include "handyHelpers.h"
+
+static int16_t quantize(float value, float scale) {
+  return (int16_t)constrain(lroundf(value * scale), -32768L, 32767L);
+}
+
+void ThrowRecorder::begin() {
+  openPartition();
+  if (xTaskCreatePinnedToCore(writerTask, "traceWriter", TRACE_WRITER_STACK, this, TRACE_WRITER_PRIORITY, &_writer, TRACE_WRITER_CORE) != pdPASS) {
+    _writer = nullptr;
+    debugln("Throw recorder: writer task not started, snapshots block the loop");
+  }
+}
+
+// Erasing a 12 KB slot takes tens of ms, so it is not done in the loop
+void ThrowRecorder::writerTask(void *parameter) {
+  ThrowRecorder *recorder = (ThrowRecorder *)parameter;
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    recorder->snapshot(recorder->_pendingReason);
+    recorder->_frozen = false;
+  }
+}
+
+bool ThrowRecorder::requestSnapshot(SnapshotReason reason) {
+  if (!_writer) {
+    return snapshot(reason);
+  }
+  if (_frozen) {
+    return false;
+  }
+  _pendingReason = reason;
+  _frozen = true;
+  xTaskNotifyGive(_writer);
+  return true;
+}
+
+void ThrowRecorder::record(const ImuSample &sample) {
+  if (_frozen) {
+    return;  //the writer task reads the window
+  }
+  int16_t values[TRACE_CHANNELS] = {
+    quantize(sample.xGyro, TRACE_GYRO_SCALE), quantize(sample.yGyro, TRACE_GYRO_SCALE), quantize(sample.zGyro, TRACE_GYRO_SCALE),
+    quantize(sample.ax, TRACE_ACCEL_SCALE), quantize(sample.ay, TRACE_ACCEL_SCALE), quantize(sample.az, TRACE_ACCEL_SCALE),
+    quantize(sample.xGravity, TRACE_ACCEL_SCALE), quantize(sample.yGravity, TRACE_ACCEL_SCALE), quantize(sample.zGravity, TRACE_ACCEL_SCALE)
+  };
+
+  TraceRecord &record = _records[_head];
+  int64_t interval = _lastTimeUs ? (sample.timeUs - _lastTimeUs) / TRACE_INTERVAL_UNIT : 0;
+  record.interval = (uint16_t)constrain(interval, 0, TRACE_KEYFRAME_FLAG - 1);
+  _lastTimeUs = sample.timeUs;
+
+  // Delta against the previous sample, keyframe when due or when a difference does not fit in int16
+  bool keyframe = ++_sinceKeyframe >= TRACE_KEYFRAME_INTERVAL;
+  for (uint8_t i = 0; i < TRACE_CHANNELS && !keyframe; i++) {
+    int32_t delta = (int32_t)values[i] - _previous[i];
+    keyframe = delta < -32768 || delta > 32767;
+  }
+  for (uint8_t i = 0; i < TRACE_CHANNELS; i++) {
+    record.values[i] = keyframe ? values[i] : (int16_t)(values[i] - _previous[i]);
+    _previous[i] = values[i];
+  }
+  if (keyframe) {
+    record.interval |= TRACE_KEYFRAME_FLAG;
+    _sinceKeyframe = 0;
+  }
+
+  _head = (_head + 1) % TRACE_RECORDS;
+  if (_count < TRACE_RECORDS) {
+    _count++;
+  }
+}
+
+const TraceRecord &ThrowRecorder::recordAt(uint16_t index) const {
+  return _records[(_head + TRACE_RECORDS - _count + index) % TRACE_RECORDS];
+}
+
+// Rebuilds absolute values from the records. Records before the first keyframe cannot be decoded and are skipped
+class TraceDecoder {
+public:
+  explicit TraceDecoder(Print &out)
+    : _out(out) {
+    _out.println("time_ms,gyro_x,gyro_y,gyro_z,acc_x,acc_y,acc_z,grav_x,grav_y,grav_z");
+  }
+  void feed(const TraceRecord &record) {
+    bool keyframe = record.interval & TRACE_KEYFRAME_FLAG;
+    if (!_started && !keyframe) {
+      return;
+    }
+    if (_started) {
+      _timeUs += (uint32_t)(record.interval & ~TRACE_KEYFRAME_FLAG) * TRACE_INTERVAL_UNIT;
+    }
+    _started = true;
+    for (uint8_t i = 0; i < TRACE_CHANNELS; i++) {
+      _values[i] = keyframe ? record.values[i] : (int16_t)(_values[i] + record.values[i]);
+    }
+    _out.printf("%.1f,%.4f,%.4f,%.4f,%.2f,%.2f,%.2f,%.2f,%.2f,%.2f\n", _timeUs / 1000.0,
+                _values[0] / TRACE_GYRO_SCALE, _values[1] / TRACE_GYRO_SCALE, _values[2] / TRACE_GYRO_SCALE,
+                _values[3] / TRACE_ACCEL_SCALE, _values[4] / TRACE_ACCEL_SCALE, _values[5] / TRACE_ACCEL_SCALE,
+                _values[6] / TRACE_ACCEL_SCALE, _values[7] / TRACE_ACCEL_SCALE, _values[8] / TRACE_ACCEL_SCALE);
+  }
+
+private:
+  Print &_out;
+  bool _started = false;
+  uint32_t _timeUs = 0;  //since the first decoded record
+  int16_t _values[TRACE_CHANNELS] = {};
+};
+
+void ThrowRecorder::printCsv(Print &out) const {
+  TraceDecoder decoder(out);
+  for (uint16_t i = 0; i < _count; i++) {
+    decoder.feed(recordAt(i));
+  }
+}
+
+bool ThrowRecorder::openPartition() {
+  if (_partitionSearched) {
+    return _partition != nullptr;
+  }
+  _partitionSearched = true;
+
+  // The firmware uses no file system, so the spiffs partition of the standard schemes is free for raw use
+  _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, TRACE_PARTITION_LABEL);
+  if (!_partition) {
+    _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_SPIFFS, NULL);
+  }
+  if (!_partition) {
+    debugln("Throw recorder: no trace partition");
+    return false;
+  }
+  _slots = min((uint32_t)_partition->size / TRACE_SLOT_SIZE, (uint32_t)255);
+
+  // Continue after the newest snapshot
+  TraceSnapshotHeader header;
+  for (uint8_t slot = 0; slot < _slots; slot++) {
+    if (readHeader(slot, header) && header.sequence >= _nextSequence) {
+      _nextSequence = header.sequence + 1;
+    }
+  }
+  debug("Throw recorder: partition ");
+  debug(_partition->label);
+  debug(", slots: ");
+  debugln(_slots);
+  return _slots > 0;
+}
+
+bool ThrowRecorder::readHeader(uint8_t slot, TraceSnapshotHeader &header) {
+  if (esp_partition_read(_partition, (size_t)slot * TRACE_SLOT_SIZE, &header, sizeof(header)) != ESP_OK) {
+    return false;
+  }
+  return header.magic == TRACE_MAGIC && header.count <= TRACE_RECORDS;
+}
+
+bool ThrowRecorder::snapshot(SnapshotReason reason) {
+  if (!openPartition()) {
+    return false;
+  }
+  uint8_t slot = _nextSequence % _slots;
+  size_t offset = (size_t)slot * TRACE_SLOT_SIZE;
+
+  TraceSnapshotHeader header = {};
+  header.magic = TRACE_MAGIC;
+  header.sequence = _nextSequence;
+  header.reason = (uint8_t)reason;
+  header.count = _count;
+  header.endTimeUs = _lastTimeUs;
+  strncpy(header.diceId, currentConfig.diceId, sizeof(header.diceId) - 1);
+
+  // Window in chronological order: the ring may wrap, so at most two writes
+  uint16_t oldest = (_head + TRACE_RECORDS - _count) % TRACE_RECORDS;
+  uint16_t firstPart = min((uint16_t)(TRACE_RECORDS - oldest), _count);
+  bool ok = esp_partition_erase_range(_partition, offset, TRACE_SLOT_SIZE) == ESP_OK
+            && esp_partition_write(_partition, offset + sizeof(header), &_records[oldest], firstPart * sizeof(TraceRecord)) == ESP_OK
+            && esp_partition_write(_partition, offset + sizeof(header) + firstPart * sizeof(TraceRecord), _records, (_count - firstPart) * sizeof(TraceRecord)) == ESP_OK
+            && esp_partition_write(_partition, offset, &header, sizeof(header)) == ESP_OK;  //header last: a torn write leaves no valid magic
+  debug("Throw recorder: snapshot ");
+  debug(_nextSequence);
+  debug(ok ? " written to slot " : " failed, slot ");
+  debugln(slot);
+  _nextSequence++;
+  return ok;
+}
+
+void ThrowRecorder::listSnapshots(Print &out) {
+  if (!openPartition()) {
+    out.println("no trace partition");
+    return;
+  }
+  TraceSnapshotHeader header;
+  for (uint8_t slot = 0; slot < _slots; slot++) {
+    if (readHeader(slot, header)) {
+      out.printf("slot %u: sequence %lu, %s, %u samples, %s, end %.3f s\n", slot, (unsigned long)header.sequence,
+                 header.reason == (uint8_t)SnapshotReason::MEASUREMENT_FAIL ? "measurementFail" : "request",
+                 header.count, header.diceId, header.endTimeUs / 1e6);
+    }
+  }
+}
+
+void ThrowRecorder::printSnapshot(Print &out, uint8_t slot) {
+  TraceSnapshotHeader header;
+  if (!openPartition() || slot >= _slots || !readHeader(slot, header)) {
+    out.println("no snapshot in that slot");
+    return;
+  }
+  TraceDecoder decoder(out);
+  TraceRecord chunk[25];
+  size_t offset = (size_t)slot * TRACE_SLOT_SIZE + sizeof(header);
+  for (uint16_t done = 0; done < header.count;) {
+    uint16_t n = min((uint16_t)(header.count - done), (uint16_t)25);
+    if (esp_partition_read(_partition, offset + done * sizeof(TraceRecord), chunk, n * sizeof(TraceRecord)) != ESP_OK) {
+      break;
+    }
+    for (uint16_t i = 0; i < n; i++) {
+      decoder.feed(chunk[i]);
+    }
+    done += n;
+  }
+}
@@ -0,0 +1,85 @@
+#ifndef THROWRECORDER_H_
+#define THROWRECORDER_H_
+
+// Rolling recorder of the last seconds of IMU samples, for "the die didn't register my throw" reports.
+// Samples are stored as int16 in BNO055 raw units, delta encoded against the previous sample with a
+// keyframe every TRACE_KEYFRAME_INTERVAL samples. A snapshot copies the window to a flash slot from a low
+// priority task, the window is frozen until it is written; the RAM window and the snapshots are printed
+// as CSV over serial (see SerialCommands.h).
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <Adafruit_Sensor.h>
+
+#define TRACE_RECORDS 500            //5 s at 100 Hz
+#define TRACE_CHANNELS 9             //gyro xyz, linear acceleration xyz, gravity xyz
+#define TRACE_KEYFRAME_INTERVAL 50   //samples between absolute records
+#define TRACE_KEYFRAME_FLAG 0x8000   //in TraceRecord.interval
+#define TRACE_INTERVAL_UNIT 100      //us per interval count
+#define TRACE_GYRO_SCALE (16.0f / SENSORS_DPS_TO_RADS)  //BNO055 raw: 16 LSB per dps
+#define TRACE_ACCEL_SCALE 100.0f                        //BNO055 raw: 100 LSB per m/s2
+
+#define TRACE_PARTITION_LABEL "traces"  //preferred data partition, otherwise the unused spiffs partition
+#define TRACE_SLOT_SIZE 12288           //flash bytes per snapshot, multiple of the 4 KB erase sector
+#define TRACE_MAGIC 0x51445452          //"QDTR"
+#define TRACE_WRITER_STACK 3072
+#define TRACE_WRITER_PRIORITY 1         //below the IMU sampler, like the log drain
+#define TRACE_WRITER_CORE 0             //the erase does not stall the loop
+
+struct TraceRecord {
+  uint16_t interval;  //bits 0-14: time since the previous sample in TRACE_INTERVAL_UNIT, bit 15: keyframe
+  int16_t values[TRACE_CHANNELS];  //keyframe: raw value, otherwise difference with the previous sample
+};
+
+enum class SnapshotReason : uint8_t {
+  REQUEST,          //serial command
+  MEASUREMENT_FAIL  //repeated measurementFail in one throw
+};
+
+struct TraceSnapshotHeader {
+  uint32_t magic;
+  uint32_t sequence;
+  uint8_t reason;
+  uint8_t reserved;
+  uint16_t count;      //records following the header
+  int64_t endTimeUs;   //esp_timer time of the last record
+  char diceId[16];
+};
+
+struct ImuSample;
+
+class ThrowRecorder {
+public:
+  void begin();                          //finds the partition and starts the writer task, during the boot
+  void record(const ImuSample &sample);  //call for every processed sample, loop task only
+
+  bool requestSnapshot(SnapshotReason reason);  //window to the next flash slot, oldest slot is overwritten.
+                                                //False while the previous snapshot is still being written
+  void printCsv(Print &out) const;       //RAM window
+  void printSnapshot(Print &out, uint8_t slot);
+  void listSnapshots(Print &out);
+
+private:
+  static void writerTask(void *parameter);
+  bool snapshot(SnapshotReason reason);
+  bool openPartition();
+  bool readHeader(uint8_t slot, TraceSnapshotHeader &header);
+  const TraceRecord &recordAt(uint16_t index) const;  //0 is the oldest record in the window
+
+  TraceRecord _records[TRACE_RECORDS];
+  uint16_t _head = 0;   //next record to write
+  uint16_t _count = 0;
+  int16_t _previous[TRACE_CHANNELS] = {};
+  uint8_t _sinceKeyframe = TRACE_KEYFRAME_INTERVAL;  //first record is a keyframe
+  int64_t _lastTimeUs = 0;
+
+  const esp_partition_t *_partition = nullptr;
+  bool _partitionSearched = false;
+  uint8_t _slots = 0;
+  uint32_t _nextSequence = 0;
+
+  TaskHandle_t _writer = nullptr;
+  volatile bool _frozen = false;  //no recording while the window is written to flash
+  SnapshotReason _pendingReason = SnapshotReason::REQUEST;
+};
+
+#endif /* THROWRECORDER_H_ */
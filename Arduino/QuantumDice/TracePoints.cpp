@@ -0,0 +1,81 @@
+#include "TracePoints.h"
+
+TraceEvent traceEvents[TRACE_EVENTS];
+TraceTask traceTasks[TRACE_TASKS];
+std::atomic<uint32_t> traceNext(0);
+volatile bool traceEnabled = true;
+volatile uint16_t traceMask = TRACE_DEFAULT_MASK;
+
+const char *tracePointName(uint8_t point) {
+  switch ((TracePoint)point) {
+    case TracePoint::IMU_READ: return "imuRead";
+    case TracePoint::CHANGE_STATE: return "changeState";
+    case TracePoint::ON_ENTRY: return "onEntry";
+    case TracePoint::WHILE_IN_STATE: return "whileInState";
+    case TracePoint::FIND_VALUES: return "findValues";
+    case TracePoint::RENDER: return "render";
+    case TracePoint::TOP_FACE: return "topFace";
+    case TracePoint::ESPNOW_SEND: return "espNowSend";
+    case TracePoint::ESPNOW_RECEIVE: return "espNowReceive";
+    case TracePoint::RNG: return "rng";
+    default: return "?";
+  }
+}
+
+// Lock free: a free slot is claimed with a compare and swap, so two new tasks cannot take the same one.
+// The name is copied after the claim; printTraceJson() falls back to the index while it is empty
+uint8_t traceTaskIndex() {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  for (uint8_t i = 0; i < TRACE_TASKS; i++) {
+    TaskHandle_t handle = traceTasks[i].handle.load(std::memory_order_acquire);
+    if (handle == nullptr && traceTasks[i].handle.compare_exchange_strong(handle, self)) {
+      strlcpy(traceTasks[i].name, pcTaskGetName(self), sizeof(traceTasks[i].name));
+      return i;
+    }
+    if (handle == self) {
+      return i;
+    }
+  }
+  return TRACE_TASKS - 1;
+}
+
+void clearTrace() {
+  traceNext = 0;
+}
+
+// Chrome trace event format, one thread per task. Times are relative to the earliest event in the
+// ring; the viewer orders events by time, so a slot written out of order only needs a valid time
+void printTraceJson(Print &out) {
+  traceEnabled = false;  //keep the ring stable while printing
+  uint32_t next = traceNext;
+  uint32_t count = min(next, (uint32_t)TRACE_EVENTS);
+  uint32_t first = next - count;
+  uint32_t baseTime = count ? traceEvents[first % TRACE_EVENTS].timeUs : 0;
+  int32_t earliest = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    earliest = min(earliest, (int32_t)(traceEvents[(first + i) % TRACE_EVENTS].timeUs - baseTime));
+  }
+  baseTime += earliest;
+
+  out.println("{\"traceEvents\":[");
+  bool comma = false;
+  for (uint8_t task = 0; task < TRACE_TASKS; task++) {  //thread names
+    if (traceTasks[task].handle.load(std::memory_order_acquire) == nullptr) {
+      break;
+    }
+    const char *name = traceTasks[task].name;
+    out.printf("%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}\n",
+               comma ? "," : "", task, name[0] ? name : "?");
+    comma = true;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    const TraceEvent &event = traceEvents[(first + i) % TRACE_EVENTS];
+    int32_t time = (int32_t)(event.timeUs - baseTime);  //signed difference survives the wrap
+    out.printf("%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%ld,\"pid\":1,\"tid\":%u,%s\"args\":{\"arg\":%u}}\n",
+               comma ? "," : "", tracePointName(event.point), event.phase, (long)max(time, (int32_t)0), event.task,
+               event.phase == 'i' ? "\"s\":\"t\"," : "", event.arg);
+    comma = true;
+  }
+  out.println("],\"displayTimeUnit\":\"ms\"}");
+  traceEnabled = true;
+}
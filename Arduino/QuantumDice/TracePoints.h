@@ -0,0 +1,104 @@
+#ifndef TRACEPOINTS_H_
+#define TRACEPOINTS_H_
+
+// Latency trace points: begin/end/instant events stamped with the esp_timer microsecond clock in a RAM ring.
+// The clock does not depend on the CPU frequency (FrequencyGovernor.h) and is shared by both cores.
+// The "perf" serial command prints the ring as Chrome trace JSON (open in ui.perfetto.dev or chrome://tracing),
+// one thread per FreeRTOS task, so a task preempted inside a scope keeps its begin/end pairs nested.
+// Enable with TRACE_POINTS in defines.h; disabled trace points compile to nothing.
+#include <Arduino.h>
+#include <atomic>
+#include <esp_timer.h>
+#include "defines.h"
+
+#define TRACE_EVENTS 2048  //power of two, 8 bytes each
+#define TRACE_TASKS 16     //tasks with their own thread in the trace, further tasks share the last one
+#define TRACE_DEFAULT_MASK (0xFFFF & ~(1 << (uint8_t)TracePoint::IMU_READ))  //100 Hz IMU reads would fill the ring in 10 s
+
+enum class TracePoint : uint8_t {
+  IMU_READ,        //sampler task, one sensor read
+  CHANGE_STATE,    //arg: trigger
+  ON_ENTRY,        //arg: state
+  WHILE_IN_STATE,  //arg: state
+  FIND_VALUES,     //truth table lookup
+  RENDER,          //callFunction, arg: screen state
+  TOP_FACE,        //instant, up face shows the result, arg: face
+  ESPNOW_SEND,
+  ESPNOW_RECEIVE,  //instant, WiFi task
+  RNG,             //ATECC random number
+  COUNT
+};
+
+struct TraceEvent {
+  uint32_t timeUs;  //esp_timer_get_time(), wraps every ~71 min
+  uint8_t point;
+  uint8_t arg;
+  char phase;       //'B' begin, 'E' end, 'i' instant
+  uint8_t task;     //index in traceTasks
+};
+
+// Registered by the first event of a task. A task created later at the address of a deleted one
+// shows under the name of the deleted task
+struct TraceTask {
+  std::atomic<TaskHandle_t> handle;
+  char name[configMAX_TASK_NAME_LEN];
+};
+
+extern TraceEvent traceEvents[TRACE_EVENTS];
+extern TraceTask traceTasks[TRACE_TASKS];
+extern std::atomic<uint32_t> traceNext;
+extern volatile bool traceEnabled;
+extern volatile uint16_t traceMask;  //bit per TracePoint, "perf <point> on|off"
+
+uint8_t traceTaskIndex();  //current task, a scan of TRACE_TASKS handles
+
+// Any task, any core: a slot is reserved with one atomic increment, the oldest event is overwritten.
+// The time is taken first; a task preempted before the reservation stores an event that is older than
+// its neighbours in the ring, printTraceJson() does not rely on the ring order
+inline void traceRecord(TracePoint point, uint8_t arg, char phase) {
+  if (!traceEnabled || !((traceMask >> (uint8_t)point) & 1)) {
+    return;
+  }
+  uint32_t timeUs = (uint32_t)esp_timer_get_time();
+  TraceEvent &event = traceEvents[traceNext.fetch_add(1, std::memory_order_relaxed) % TRACE_EVENTS];
+  event.timeUs = timeUs;
+  event.point = (uint8_t)point;
+  event.arg = arg;
+  event.phase = phase;
+  event.task = traceTaskIndex();
+}
+
+class TraceScope {
+public:
+  TraceScope(TracePoint point, uint8_t arg)
+    : _point(point), _arg(arg) {
+    traceRecord(point, arg, 'B');
+  }
+  ~TraceScope() {
+    traceRecord(_point, _arg, 'E');
+  }
+
+private:
+  TracePoint _point;
+  uint8_t _arg;
+};
+
+void printTraceJson(Print &out);
+void clearTrace();
+const char *tracePointName(uint8_t point);
+
+#if TRACE_POINTS == 1
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(point, arg) TraceScope TRACE_CONCAT(traceScope, __LINE__)(TracePoint::point, (uint8_t)(arg))
+#define TRACE_BEGIN(point, arg) traceRecord(TracePoint::point, (uint8_t)(arg), 'B')
+#define TRACE_END(point, arg) traceRecord(TracePoint::point, (uint8_t)(arg), 'E')
+#define TRACE_INSTANT(point, arg) traceRecord(TracePoint::point, (uint8_t)(arg), 'i')
+#else
+#define TRACE_SCOPE(point, arg)
+#define TRACE_BEGIN(point, arg)
+#define TRACE_END(point, arg)
+#define TRACE_INSTANT(point, arg)
+#endif
+
+#endif /* TRACEPOINTS_H_ */
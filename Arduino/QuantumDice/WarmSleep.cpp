@@ -0,0 +1,109 @@
+#include "defines.h"
+#include "WarmSleep.h"
+#include <esp_sleep.h>
+#include <esp_system.h>
+#include <driver/gpio.h>
+#include <sys/time.h>
+#include "IMUhelpers.h"
+#include "Screenfunctions.h"
+#include "I2CScheduler.h"
+
+RTC_DATA_ATTR WarmState warmState;
+
+static uint64_t rtcTimeUs() {  //keeps counting during deep sleep, unlike esp_timer
+  struct timeval now;
+  gettimeofday(&now, nullptr);
+  return (uint64_t)now.tv_sec * 1000000ULL + now.tv_usec;
+}
+
+// Pins that keep their level while the ESP32 sleeps: regulator on, displays deselected and out of reset
+static void holdPin(uint8_t pin, bool hold, uint8_t level) {
+  if (hold) {
+    gpio_hold_en((gpio_num_t)pin);
+  } else {
+    pinMode(pin, OUTPUT);  //drive the held level before releasing, no glitch
+    digitalWrite(pin, level);
+    gpio_hold_dis((gpio_num_t)pin);
+  }
+}
+
+static void holdPins(bool hold) {
+  holdPin(REGULATOR_PIN, hold, LOW);
+  holdPin(hwPins.tft_rst, hold, HIGH);
+  for (int i = 0; i < 6; i++) {
+    holdPin(hwPins.screen_cs[i], hold, HIGH);
+  }
+  if (hold) {
+    gpio_deep_sleep_hold_en();
+  }
+}
+
+static void deepSleep() {
+  uint64_t wakePins = 1ULL << BUTTON_PIN;  //button is active high
+#if IMU_INT_PIN >= 0
+  wakePins |= 1ULL << IMU_INT_PIN;
+#endif
+  esp_sleep_enable_ext1_wakeup(wakePins, ESP_EXT1_WAKEUP_ANY_HIGH);
+  esp_sleep_enable_timer_wakeup(WARM_SLEEP_MAX_TIME * 1000ULL);
+  warmState.sleepStartUs = rtcTimeUs();
+  holdPins(true);
+  esp_deep_sleep_start();
+}
+
+// Still after WARM_SLEEP_MAX_TIME: cut the power as without warm sleep. On USB power the ESP32 stays on,
+// so it sleeps until the button and then boots cold
+static void powerOff() {
+  warmState.magic = 0;
+  holdPins(false);
+  digitalWrite(REGULATOR_PIN, HIGH);
+  esp_sleep_enable_ext1_wakeup(1ULL << BUTTON_PIN, ESP_EXT1_WAKEUP_ANY_HIGH);
+  esp_deep_sleep_start();
+}
+
+bool warmResume() {
+  if (!WARM_SLEEP_ENABLED || esp_reset_reason() != ESP_RST_DEEPSLEEP || warmState.magic != WARM_STATE_MAGIC) {
+    warmState.magic = 0;
+    return false;
+  }
+  // Configuration as it was at sleep: no EEPROM read and no validation. The pins are needed for the holds
+  currentConfig = warmState.config;
+  initHardwarePins();
+  warmState.asleepMs += (rtcTimeUs() - warmState.sleepStartUs) / 1000;
+
+  if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_TIMER) {  //WARM_SLEEP_MAX_TIME without motion
+    powerOff();
+  }
+
+  holdPins(false);
+  warmState.magic = 0;  //a reset while awake is a cold boot
+  warmState.resumes++;
+  return true;
+}
+
+void restoreRandomPool() {
+  uint32_t seed = 0;
+  for (uint8_t i = 0; i < sizeof(warmState.randomPool); i++) {
+    seed = seed * 31 + warmState.randomPool[i];
+  }
+  randomSeed(seed);
+}
+
+void enterWarmSleep(StateMachine &stateMachine, IMUSensor *imuSensor) {
+  debugln("Warm sleep");
+  imuSensor->stopSampler();
+  warmState.dice = stateMachine.snapshot();
+  warmState.config = currentConfig;
+  if (!readRandomBlock(warmState.randomPool)) {
+    for (uint8_t i = 0; i < sizeof(warmState.randomPool); i++) {
+      warmState.randomPool[i] = random(256);
+    }
+  }
+  i2cScheduler.lockAtecc();  //no ATECC command from the worker while the bus goes to sleep, released by the reset
+  warmState.asleepMs = 0;
+  warmState.magic = WARM_STATE_MAGIC;
+
+  imuSensor->prepareSleep();
+  sleepDisplays();
+  delay(10);  //let the deferred log drain
+  deepSleep();
+}
@@ -0,0 +1,35 @@
+#ifndef WARMSLEEP_H_
+#define WARMSLEEP_H_
+
+// Warm sleep: instead of cutting the power after deepSleepTimeout, the ESP32 goes into deep sleep with
+// the regulator held on. The state machine snapshot, configuration, peer roles and a random pool stay
+// in RTC memory, the BNO055 keeps its calibration in low power accelerometer only mode and the displays
+// keep their frame memory. A motion or button wake resumes in the same dice state without config parsing,
+// calibration restore or logo screen; the resume time is reported with the boot times.
+#include <Arduino.h>
+#include "defines.h"
+#include "StateMachine.h"
+#include "handyHelpers.h"
+
+#define WARM_SLEEP_ENABLED (WARM_SLEEP == 1 && IMU_INT_PIN >= 0)  //the motion wake needs the BNO055 INT pin
+#define WARM_SLEEP_MAX_TIME 3600000       //ms asleep without motion before the power is cut after all
+#define WARM_STATE_MAGIC 0x51445753       //"QDWS"
+
+struct WarmState {
+  uint32_t magic;
+  DiceSnapshot dice;
+  DiceConfig config;
+  uint8_t randomPool[32];  //ATECC block, seeds the fallback generator on resume
+  uint32_t asleepMs;
+  uint64_t sleepStartUs;   //RTC time when going to sleep
+  uint16_t resumes;
+};
+
+extern RTC_DATA_ATTR WarmState warmState;
+
+bool warmResume();  //early in setup(): true after a warm sleep with motion or button, cuts the power after
+                    //WARM_SLEEP_MAX_TIME. Restores the configuration and hardware pins
+void restoreRandomPool();
+void enterWarmSleep(StateMachine &stateMachine, IMUSensor *imuSensor);  //does not return
+
+#endif /* WARMSLEEP_H_ */
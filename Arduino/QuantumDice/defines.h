@@ -4,12 +4,32 @@
 
 #define DEBUG 1
 
+// Log modules for debug(), one bit each. A .cpp file picks its module with #define LOG_MODULE before its includes
+#define LOG_MAIN 0
+#define LOG_STATE 1
+#define LOG_IMU 2
+#define LOG_SCREEN 3
+#define LOG_I2C 4
+#define LOG_POWER 5    //power tiers and the CPU frequency governor
+#define LOG_BATTERY 6
+#define LOG_PROF 7
+#define LOG_MODULES_COMPILED 0xFF  //bit per module, cleared bits are removed at compile time. Runtime: "log" serial command
+#define LOG_BINARY 0  //1: debugRecord() is sent as binary frames for ../HostTools/LogDecoder.cpp, 0: formatted by the drain task
+
+#ifndef LOG_MODULE
+#define LOG_MODULE LOG_MAIN
+#endif
+
 #if DEBUG == 1
-#define debug(x) Serial.print(x)
-#define debugln(x) Serial.println(x)
+#include "DeferredLog.h"
+#define LOG_ON (((LOG_MODULES_COMPILED >> LOG_MODULE) & 1) && logEnabled(LOG_MODULE))
+#define debug(x) do { if (LOG_ON) deferredLog.print(x); } while (0)
+#define debugln(x) do { if (LOG_ON) deferredLog.println(x); } while (0)
+#define debugRecord(format, ...) do { if (LOG_ON) deferredLog.record(LogFormat::format, ##__VA_ARGS__); } while (0)  //LogRecords.h
 #else
 #define debug(x)
 #define debugln(x)
+#define debugRecord(format, ...)
 #endif
 
 #define MAXBATERYVOLTAGE 4.00 //under load 4.2 -> 4.0
@@ -17,8 +37,30 @@
 #define BATTERYSTABTIME 1000 //waiting time to stabilize battery voltage after diceState change
 #define MOVINGTHRESHOLD 0.7 //maximum acceleration magnitude to detect nonMoving
 
+#define SERIAL_WAIT_TIMEOUT 100 //ms to wait for a USB serial monitor at boot, the "boot" command reprints the boot times
+
 #define REGULATOR_PIN GPIO_NUM_18 //pin D9
 #define BUTTON_PIN GPIO_NUM_14
+#define IMU_INT_PIN -1 //GPIO wired to the BNO055 INT pin, -1 when not connected (motion polling, no warm sleep)
+
+#define TRACE_POINTS 1 //latency trace points (TracePoints.h), dump with the "perf" serial command
+
+#define IRAM_HOT_PATHS 1 //1: radio receive path, IMU integration and compositing kernels in IRAM, checked by the self test
+#if IRAM_HOT_PATHS == 1
+#define HOT_PATH IRAM_ATTR
+#else
+#define HOT_PATH
+#endif
+
+#define ALLOCATION_CHECK 0 //1: abort on a heap allocation by the loop task in a loop iteration after setup() (MemoryBudget.h), needs CONFIG_HEAP_USE_HOOKS, otherwise heap block growth is logged
+
+#define GOVERNOR 1 //1: low CPU frequency outside render bursts and measurement (FrequencyGovernor.h), 0: always full clock
+
+#define WARM_SLEEP 1 //1: deep sleep with RTC-retained state after deepSleepTimeout when IMU_INT_PIN is wired (WarmSleep.h), 0: cut the power
+
+#define SYNTHETIC_IMU 0 //1: replace the BNO055 by the synthetic throw generator (SyntheticIMU.h) to stress-test motion detection
+
+#define DEV_TOOLS 0 //1: serial commands "bench", "synth", "tune" and "power sim", which block the loop for seconds; development builds only
 
 
 #endif /* DEFINES_H_ */
\ No newline at end of file
@@ -2,6 +2,11 @@
 #include "defines.h"
 #include "IMUhelpers.h"
 #include "handyHelpers.h"
+#include "BatteryMonitor.h"
+#include "I2CScheduler.h"
+#include "Orientation.h"
+#include "TracePoints.h"
+#include "DeferredLog.h"
 
 // Define global configuration object
 DiceConfig currentConfig;
@@ -14,6 +19,7 @@ bool randomChipPresent = false;
 Button2 button;
 bool clicked = false;
 bool longclicked = false;
+bool selfTestRequested = false;
 
 /**
  * Initialize hardware pins based on configuration
@@ -257,6 +263,12 @@ bool loadConfigFromEEPROM() {
     Serial.println("ERROR: Invalid configuration in EEPROM");
     return false;
   }
+
+  // Configurations written before the mounting matrix existed: derive it from the board type
+  if (!validMountingMatrix(currentConfig.mounting)) {
+    Serial.println("No valid mounting matrix, using the preset for the board type");
+    presetMountingMatrix(currentConfig.isNano, currentConfig.mounting);
+  }
   
   Serial.println("Configuration loaded successfully!");
   printConfig(currentConfig);
@@ -309,6 +321,10 @@ void printConfig(const DiceConfig& config) {
                 config.isSMD ? "SMD" : "HDR",
                 config.isNano ? "NANO" : "DEVKIT");
   Serial.printf("Always Seven: %s\n", config.alwaysSeven ? "Yes" : "No");
+  Serial.printf("Mounting: [%d %d %d] [%d %d %d] [%d %d %d]\n",
+                config.mounting[0], config.mounting[1], config.mounting[2],
+                config.mounting[3], config.mounting[4], config.mounting[5],
+                config.mounting[6], config.mounting[7], config.mounting[8]);
   
   Serial.printf("\nTiming Constants:\n");
   Serial.printf("  Random Switch Point: %d\n", config.randomSwitchPoint);
@@ -323,32 +339,12 @@ void printConfig(const DiceConfig& config) {
 
 // ... (rest of existing functions remain the same)
 
-void checkTimeForDeepSleep(IMUSensor *imuSensor) {
-  static bool isMoving = false;
-  static unsigned long lastMovementTime = 0;
-
-  if (imuSensor->isNotMoving()) {
-    if (isMoving) {
-      lastMovementTime = millis();
-      isMoving = false;
-    }
-  } else {
-    isMoving = true;
-  }
-
-  // Use the timeout from configuration
-  if (!isMoving && (millis() - lastMovementTime > currentConfig.deepSleepTimeout)) {
-    lastMovementTime = millis();  // Reset the timer
-    debugln("Time to sleep");
-    digitalWrite(REGULATOR_PIN, HIGH);
-  }
-}
-
 void initButton() {
   button.begin(BUTTON_PIN, INPUT, false);
   button.setLongClickDetectedHandler(longClickDetected);
   button.setLongClickTime(1000);
   button.setClickHandler(click);
+  button.setTripleClickHandler(tripleClick);
 }
 
 void longClickDetected(Button2& btn) {
@@ -361,15 +357,30 @@ void click(Button2& btn) {
   clicked = true;
 }
 
+void tripleClick(Button2& btn) {
+  debugln("triple pressed, self test");
+  selfTestRequested = true;
+}
+
 void initRandomGenerators() {
   //create pseudo random numbers based on analogRead value
   randomSeed(analogRead(A0));
+  int64_t start = i2cScheduler.beginTransaction(I2cDevice::ATECC);
   randomChipPresent = atecc.begin();
+  i2cScheduler.endTransaction(I2cDevice::ATECC, start);
+  i2cScheduler.begin();  //fetches random bytes ahead, between IMU reads
 }
 
 uint8_t generateDiceRoll() {
-  // Get a random 32-bit integer from the crypto chip
-  uint32_t randomNumber = atecc.getRandomInt();
+  TRACE_SCOPE(RNG, 0);
+  // Get a random 32-bit integer from the crypto chip, fetched ahead into the pool
+  uint32_t randomNumber = 0;
+  if (!i2cScheduler.takeRandom((uint8_t *)&randomNumber, sizeof(randomNumber)) && i2cScheduler.lockAtecc()) {
+    int64_t start = i2cScheduler.beginTransaction(I2cDevice::ATECC);
+    randomNumber = atecc.getRandomInt();
+    i2cScheduler.endTransaction(I2cDevice::ATECC, start);
+    i2cScheduler.unlockAtecc();
+  }
 
   // Check if we got a valid random number (0 indicates error)
   if (randomNumber == 0) {
@@ -381,16 +392,39 @@ uint8_t generateDiceRoll() {
   return (randomNumber % 6) + 1;
 }
 
+bool readRandomBlock(uint8_t *block) {
+  if (!randomChipPresent || !i2cScheduler.lockAtecc()) {
+    return false;
+  }
+  int64_t start = i2cScheduler.beginTransaction(I2cDevice::ATECC);
+  bool fetched = atecc.updateRandom32Bytes();
+  i2cScheduler.endTransaction(I2cDevice::ATECC, start);
+  if (fetched && block) {
+    memcpy(block, atecc.random32Bytes, sizeof(atecc.random32Bytes));
+  }
+  i2cScheduler.unlockAtecc();
+  return fetched;
+}
+
 uint8_t generateDiceRollRejection() {
   uint8_t randomByte;
 
   do {
-    // Get a random byte from the crypto chip
-    randomByte = atecc.getRandomByte();
+    // Get a random byte from the pool or the crypto chip
+    if (!i2cScheduler.takeRandom(&randomByte, 1)) {
+      if (!i2cScheduler.lockAtecc()) {
+        randomByte = 0;  //reported as an error below
+      } else {
+        int64_t start = i2cScheduler.beginTransaction(I2cDevice::ATECC);
+        randomByte = atecc.getRandomByte();
+        i2cScheduler.endTransaction(I2cDevice::ATECC, start);
+        i2cScheduler.unlockAtecc();
+      }
+    }
 
     // Check for error (getRandomByte might return 0 on error)
     if (randomByte == 0) {
-      Serial.println("ERROR: Failed to get random byte");
+      consoleOut.println("ERROR: Failed to get random byte");
       return 1;
     }
   } while (randomByte >= 252);  // 252 = 6 * 42, ensures uniform distribution
@@ -399,12 +433,7 @@ uint8_t generateDiceRollRejection() {
 }
 
 bool checkMinimumVoltage() {
-  float voltage = analogReadMilliVolts(hwPins.adc_pin) / 1000.0 * 2.0;  //ADC measures 50% of battery voltage by 50/50 voltage divider
-  //debugln(voltage);
-  if (voltage < MINBATERYVOLTAGE && voltage > 0.5) //while on USB the voltage is 0
-    return true;
-  else
-    return false;
+  return batteryMonitor.isLow();  //filtered, with hysteresis, see BatteryMonitor.h
 }
 
 float mapFloat(float x, float in_min, float in_max, float out_min, float out_max, bool clipOutput) {
@@ -422,7 +451,13 @@ bool withinBounds(float val, float minimum, float maximum) {
   return ((minimum <= val) && (val <= maximum));
 }
 
-void initSerial() {
+void initSerial(bool waitForMonitor) {
   Serial.begin(115200);
-  delay(1000);
+  unsigned long start = millis();
+  while (waitForMonitor && !Serial && millis() - start < SERIAL_WAIT_TIMEOUT) {  //USB CDC: until a monitor is attached, if any
+    delay(1);
+  }
+#if DEBUG == 1
+  deferredLog.begin();
+#endif
 }
\ No newline at end of file
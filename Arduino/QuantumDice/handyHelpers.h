@@ -33,6 +33,7 @@ struct DiceConfig {
   uint8_t randomSwitchPoint;    // Threshold for random value (0-100)
   float tumbleConstant;         // Number of tumbles to detect tumbling
   uint32_t deepSleepTimeout;    // Deep sleep timeout in milliseconds
+  int8_t mounting[9];           // IMU mounting matrix, sensor to dice frame (see Orientation.h)
   
   uint8_t checksum;             // Simple checksum for validation
 };
@@ -72,21 +73,24 @@ void printHardwarePins();
 
 // Existing declarations
 extern RTC_DATA_ATTR int bootCount;
+extern ATECCX08A atecc;  //shared with the I2C worker, see I2CScheduler.h
 extern bool randomChipPresent;
 extern Button2 button;
 extern bool clicked;
 extern bool longclicked;
+extern bool selfTestRequested;
 
 void initButton();
 void longClickDetected(Button2& btn);
 void click(Button2& btn);
-void checkTimeForDeepSleep(IMUSensor *imuSensor);
+void tripleClick(Button2& btn);
 bool checkMinimumVoltage();
 float mapFloat(float x, float in_min, float in_max, float out_min, float out_max, bool clipOutput);
 bool withinBounds(float val, float minimum, float maximum);
-void initSerial();
+void initSerial(bool waitForMonitor = true);
 void initRandomGenerators();
 uint8_t generateDiceRollRejection();
 uint8_t generateDiceRoll();
+bool readRandomBlock(uint8_t *block = nullptr);  //32 random bytes from the ATECC, copied to block when given
 
 #endif /* HANDYHELPERS_H_ */
\ No newline at end of file
@@ -54,8 +54,13 @@ struct DiceConfig {
   uint8_t randomSwitchPoint;
   float tumbleConstant;
   uint32_t deepSleepTimeout;
+  int8_t mounting[9];  // IMU mounting matrix, sensor to dice frame, row major
 };
 
+// IMU mounting presets: NANO has the IMU on the X+ side (left), DEVKIT on the Y- side (rear)
+const int8_t nanoMounting[9] = { 0, -1, 0, 0, 0, -1, 1, 0, 0 };
+const int8_t devkitMounting[9] = { 0, 0, 1, 0, -1, 0, 1, 0, 0 };
+
 // Default configuration
 const DiceConfig defaultConfig = {
   .diceId = "TEST1",
@@ -73,7 +78,8 @@ const DiceConfig defaultConfig = {
   .alwaysSeven = false,
   .randomSwitchPoint = 50,
   .tumbleConstant = 0.2,
-  .deepSleepTimeout = 300000  // 5 minutes
+  .deepSleepTimeout = 300000,  // 5 minutes
+  .mounting = { 0, 0, 1, 0, -1, 0, 1, 0, 0 }  // devkitMounting
 };
 
 // ==================== GLOBAL OBJECTS ====================
@@ -110,6 +116,8 @@ void printEvent(sensors_event_t* event);
 
 // EEPROM Configuration functions
 bool validateConfig(const DiceConfig& config);
+bool validMountingMatrix(const int8_t mounting[9]);
+int readMountingFromSerial(int8_t* mounting);
 void printConfig(const DiceConfig& config, const char* title);
 bool readEEPROMConfig(DiceConfig& config);
 void writeEEPROMConfig(const DiceConfig& config);
@@ -1070,6 +1078,24 @@ void configureEEPROMSettings() {
   if (input.length() > 0) {
     newConfig.isNano = (input[0] == 'Y' || input[0] == 'y');
   }
+  // IMU Mounting: board preset, or nine values for a board revision with the IMU elsewhere
+  const int8_t* presetMounting = newConfig.isNano ? nanoMounting : devkitMounting;
+  bool keepMounting = newConfig.isNano == displayDefaults.isNano && validMountingMatrix(displayDefaults.mounting);
+  memcpy(newConfig.mounting, keepMounting ? displayDefaults.mounting : presetMounting, 9);
+  Serial.printf("IMU mounting matrix [%d %d %d  %d %d %d  %d %d %d]\n",
+                newConfig.mounting[0], newConfig.mounting[1], newConfig.mounting[2],
+                newConfig.mounting[3], newConfig.mounting[4], newConfig.mounting[5],
+                newConfig.mounting[6], newConfig.mounting[7], newConfig.mounting[8]);
+  Serial.println("Enter 9 values -1/0/1 row major (dice = M * sensor), P for the board preset, or press ENTER:");
+  int mountingResult = readMountingFromSerial(newConfig.mounting);
+  if (mountingResult == -1) {
+    Serial.println("\nConfiguration cancelled by user.");
+    Serial.println("Press M for menu");
+    return;
+  }
+  if (mountingResult == 2) {
+    memcpy(newConfig.mounting, presetMounting, 9);
+  }
   
   // Screen Type
   Serial.printf("Is SMD screen? (Y/N) [%s]: ", displayDefaults.isSMD ? "Y" : "N");
@@ -1286,6 +1312,57 @@ int readMacFromSerial(uint8_t* mac) {
   return 1;
 }
 
+// Returns: -1 = quit, 0 = keep, 1 = new matrix entered, 2 = board preset
+int readMountingFromSerial(int8_t* mounting) {
+  while (true) {
+    String input = readSerialLine();
+    if (input == "QUIT_CONFIG") {
+      return -1;
+    }
+    if (input.length() == 0) {
+      return 0;
+    }
+    if (input == "P" || input == "p") {
+      return 2;
+    }
+
+    int values[9];
+    int count = sscanf(input.c_str(), "%d%*[ ,]%d%*[ ,]%d%*[ ,]%d%*[ ,]%d%*[ ,]%d%*[ ,]%d%*[ ,]%d%*[ ,]%d",
+                       &values[0], &values[1], &values[2], &values[3], &values[4], &values[5], &values[6], &values[7], &values[8]);
+    int8_t entered[9];
+    for (int i = 0; i < 9; i++) {
+      entered[i] = (count == 9 && values[i] >= -1 && values[i] <= 1) ? values[i] : 2;
+    }
+    if (count == 9 && validMountingMatrix(entered)) {
+      memcpy(mounting, entered, 9);
+      return 1;
+    }
+    Serial.println("Not a rotation: one +-1 per row and column, no mirror image. Try again:");
+  }
+}
+
+// Signed permutation with determinant +1, as validMountingMatrix() in the firmware (Orientation.cpp)
+bool validMountingMatrix(const int8_t mounting[9]) {
+  uint8_t columnsUsed = 0;
+  for (int row = 0; row < 3; row++) {
+    int nonZero = 0;
+    for (int col = 0; col < 3; col++) {
+      int8_t v = mounting[row * 3 + col];
+      if (v == 0) continue;
+      if (v != 1 && v != -1) return false;
+      if (columnsUsed & (1 << col)) return false;
+      columnsUsed |= (1 << col);
+      nonZero++;
+    }
+    if (nonZero != 1) return false;
+  }
+  const int8_t* m = mounting;
+  int det = m[0] * (m[4] * m[8] - m[5] * m[7])
+            - m[1] * (m[3] * m[8] - m[5] * m[6])
+            + m[2] * (m[3] * m[7] - m[4] * m[6]);
+  return det == 1;
+}
+
 bool validateConfig(const DiceConfig& config) {
   Serial.println("\nValidating configuration...");
 
@@ -1331,6 +1408,12 @@ bool validateConfig(const DiceConfig& config) {
     return false;
   }
 
+  // Validate mounting matrix
+  if (!validMountingMatrix(config.mounting)) {
+    Serial.println("  ✗ Invalid IMU mounting matrix");
+    return false;
+  }
+
   Serial.println("✓ All validation checks passed");
   return true;
 }
@@ -1374,6 +1457,10 @@ void printConfig(const DiceConfig& config, const char* title) {
   Serial.println("\nHardware Configuration:");
   Serial.printf("  Board Type:         %s\n", config.isNano ? "NANO" : "DEVKIT");
   Serial.printf("  Screen Type:        %s\n", config.isSMD ? "SMD" : "HDR");
+  Serial.printf("  IMU Mounting:       [%d %d %d] [%d %d %d] [%d %d %d]\n",
+                config.mounting[0], config.mounting[1], config.mounting[2],
+                config.mounting[3], config.mounting[4], config.mounting[5],
+                config.mounting[6], config.mounting[7], config.mounting[8]);
 
   Serial.println("\nOperational Parameters:");
   Serial.printf("  RSSI Limit:         %d dBm\n", config.rssiLimit);
@@ -1389,6 +1476,9 @@ void printConfig(const DiceConfig& config, const char* title) {
 
 bool readEEPROMConfig(DiceConfig& config) {
   EEPROM.get(EEPROM_CONFIG_ADDRESS, config);
+  if (!validMountingMatrix(config.mounting)) {  // written before the matrix existed, as the firmware does at boot
+    memcpy(config.mounting, config.isNano ? nanoMounting : devkitMounting, 9);
+  }
   return validateConfig(config);
 }
 